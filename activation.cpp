@@ -1,71 +1,11 @@
 #include <iostream>
-#include <concepts>
-#include <cmath>
+#include <vector>
 
-namespace activation {
-    template <std::floating_point T>
-    static constexpr T sigmoid (T const& z) {
-        // bad for activation due to vanishing gradient
-        // okay for gating functions
-        using std::exp;
-        return T{1}/(T{1}+exp(-z));
-    }
+#if __has_include(<experimental/simd>)
+#include <experimental/simd>
+#endif
 
-    template <std::floating_point T>
-    static constexpr T tanh (T const& z) {
-        // zero-centered (better than sigmoid)
-        // used in recurrent nn and lstm
-        using std::tanh;
-        return tanh(z);
-    }
-
-    template <std::floating_point T>
-    static constexpr T relu (T const& z) {
-        // most popular, best performance in cnn
-        using std::max;
-        return max(T{0}, z);
-    }
-
-    template <std::floating_point T>
-    static constexpr T prelu (T const& z, T const& alpha) {
-        // parameteric relu
-        return z > T{0} ? z : z*alpha;
-    }
-
-    template <std::floating_point T>
-    static constexpr T elu (T const& z, T const& alpha) {
-        // exponentially linear unit
-        using std::exp;
-        return z > T{0} ? z : alpha*(exp(z) - 1);
-    }
-
-    template <std::floating_point T>
-    static constexpr T glu (T const& z) {
-        // gated linear unit
-        return z*activation::sigmoid(z);
-    }
-
-    template <std::floating_point T>
-    static constexpr T swish (T const& z) {
-        // sparsity, no saturation
-        // small negativesa are not zero'd out
-        return activation::glu(z);
-    }
-
-    template <std::floating_point T>
-    static constexpr T softplus (T const& z, T const& beta) {
-        using std::log, std::exp;
-        return log(T{1} + exp(z*beta))/beta;
-    }
-
-    template <std::floating_point T>
-    static constexpr T mish (T const& z) {
-        // no saturation, continuous
-        // small negativesa are not zero'd out
-        using std::tanh;
-        return z*tanh(activation::softplus(z, T{1}));
-    }
-}
+#include "activation.hpp"
 
 int main () {
     std::cout << "sigmoid(2) = " << activation::sigmoid(2.0) << std::endl;
@@ -77,6 +17,90 @@ int main () {
     std::cout << "swish(2) = " << activation::swish(2.0) << std::endl;
     std::cout << "softplus(2) = " << activation::softplus(2.0, 0.1) << std::endl;
     std::cout << "mish(2) = " << activation::mish(2.0) << std::endl;
+    std::cout << "gelu(2) = " << activation::gelu(2.0) << std::endl;
+    std::cout << "gelu_tanh(2) = " << activation::gelu_tanh(2.0) << std::endl;
+    std::cout << "silu(2) = " << activation::silu(2.0) << std::endl;
+    std::cout << "hard_sigmoid(2) = " << activation::hard_sigmoid(2.0) << std::endl;
+    std::cout << "hard_swish(2) = " << activation::hard_swish(2.0) << std::endl;
+    std::cout << "leaky_relu(-2) = " << activation::leaky_relu(-2.0) << std::endl;
+    std::cout << "selu(-2) = " << activation::selu(-2.0) << std::endl;
+    std::cout << "softsign(2) = " << activation::softsign(2.0) << std::endl;
+
+    std::vector<double> zs = {-2.0, -0.5, 0.0, 0.5, 2.0};
+    std::vector<double> out(zs.size());
+
+    auto print_range = []<typename Range>(Range const& r) -> void {
+        std::cout << "{ ";
+        for (auto v : r) {
+            std::cout << v << " ";
+        }
+        std::cout << "}" << std::endl;
+    };
+
+    activation::sigmoid<double>(zs, out);
+    std::cout << "sigmoid(zs) = "; print_range(out);
+    activation::elu<double>(zs, out, 0.1);
+    std::cout << "elu(zs) = "; print_range(out);
+    activation::mish<double>(zs, out);
+    std::cout << "mish(zs) = "; print_range(out);
+    activation::mish<double, activation::accuracy::fast>(zs, out);
+    std::cout << "mish(zs), fast = "; print_range(out);
+    activation::gelu<double>(zs, out);
+    std::cout << "gelu(zs) = "; print_range(out);
+    activation::hard_swish<double>(zs, out);
+    std::cout << "hard_swish(zs) = "; print_range(out);
+
+    // a degree 7 minimax table for sigmoid on [-2, 2], fitted at compile time
+    constexpr auto fitted = activation::math::remez<7>(activation::math::reference::sigmoid, -2.0L, 2.0L);
+    constexpr auto table = activation::math::minimax<float, 7>(activation::math::reference::sigmoid, -2.0L, 2.0L);
+    std::cout << "sigmoid minimax, degree 7 on [-2, 2] = "; print_range(table);
+    std::cout << "  max relative error = " << double(fitted.error) << std::endl;
+    std::cout << "  p(0.5) = " << activation::math::horner(table, 0.5f) << std::endl;
+
+    std::vector<double> grad(zs.size());
+    std::vector<double> grad_out(zs.size(), 1.0);
+    activation::mish_forward<double>(zs, out, grad);
+    std::cout << "mish'(zs) = "; print_range(grad);
+    activation::backward<double>(grad, grad_out, grad_out);
+    std::cout << "mish backward(1) = "; print_range(grad_out);
+    std::cout << "mish'(2) = " << activation::mish_grad(2.0) << std::endl;
+
+#if __has_include(<experimental/simd>)
+    // the scalar functions also take simd packs, every lane at once
+    using pack = std::experimental::fixed_size_simd<double, 4>;
+    pack z([](int i) { return -1.5 + i; });
+    pack e = activation::elu(z, 0.1);
+    pack m = activation::mish<pack, activation::accuracy::ulp1>(z);
+    std::cout << "elu, pack of 4 = { ";
+    for (std::size_t i = 0; i < pack::size(); ++i) std::cout << e[i] << " ";
+    std::cout << "}" << std::endl;
+    std::cout << "mish, pack of 4 = { ";
+    for (std::size_t i = 0; i < pack::size(); ++i) std::cout << m[i] << " ";
+    std::cout << "}" << std::endl;
+#endif
+
+    // a swiglu over two rows of [value | gate], each of width 2
+    std::vector<double> halves = {1.0, -2.0, 0.5, 3.0,
+                                  0.3, 0.1, -1.0, 2.0};
+    std::vector<double> gated(4), gated_grad(8);
+    activation::gated::swiglu<double>(halves, gated, 2);
+    std::cout << "swiglu(halves) = "; print_range(gated);
+    activation::gated::swiglu_backward<double>(halves, std::vector<double>(4, 1.0), gated_grad, 2);
+    std::cout << "swiglu backward(1) = "; print_range(gated_grad);
+
+    // a prelu with one alpha per channel over 2 channels of 3 values, nchw
+    std::vector<double> image = {1.0, -2.0, 0.5,
+                                 -1.0, 3.0, -0.5};
+    std::vector<double> alpha = {0.1, 0.2}, channel_out(6), channel_grad(6), alpha_grad(2);
+    activation::channel::prelu<double>(image, channel_out, alpha, 3, activation::channel::layout::nchw);
+    std::cout << "prelu(image, alpha) = "; print_range(channel_out);
+    activation::channel::prelu_backward<double>(image, std::vector<double>(6, 1.0), channel_grad, alpha_grad, alpha, 3,
+                                                activation::channel::layout::nchw);
+    std::cout << "prelu backward(1) = "; print_range(channel_grad);
+    std::cout << "prelu backward(1), alpha = "; print_range(alpha_grad);
+
+    activation::relu<double>(zs);
+    std::cout << "relu(zs) in-place = "; print_range(zs);
 
     return 0;
 }
@@ -0,0 +1,1688 @@
+#pragma once
+
+#include <concepts>
+#include <cmath>
+
+#include <bit>
+#include <array>
+#include <span>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cassert>
+#include <utility>
+#include <type_traits>
+
+namespace activation {
+    namespace accuracy {
+        // accuracy policies of the transcendental functions in activation::math
+        // and of the activations built on them. the bounds are the max error of
+        // exp, expm1, log1p, tanh and erfc over their whole float/double domains,
+        // measured against libm. the approximate ones are branch-free and
+        // vectorize, they differ only in the degree of the minimax polynomials
+        // fitted at compile time, see math::remez
+        struct exact {};    // libm, scalar calls
+        struct ulp1 {};     // exp and log1p 1 ulp, expm1 2 ulp, tanh 4 ulp, erfc 9 ulp
+        struct ulp3 {};     // exp and expm1 3 ulp, log1p 1 ulp, tanh 4 ulp, erfc 14 ulp
+        struct fast {};     // 5e-5 relative for all five, normal results
+
+        template <typename A>
+        concept policy = std::same_as<A, exact> || std::same_as<A, ulp1> || std::same_as<A, ulp3> || std::same_as<A, fast>;
+    }
+
+    // the scalar activations and the math functions below take a float or
+    // double, or a simd pack of them such as std::experimental::native_simd<float>
+    // and then compute every lane at once. a pack is any type with a floating
+    // point value_type, a static size(), lane access and where(mask, pack) = pack
+    // found by adl, so other vector wrappers qualify by providing the same
+    template <typename T>
+    concept pack = std::floating_point<typename T::value_type> && requires (T x, T const y, std::size_t i) {
+        { T::size() } -> std::convertible_to<std::size_t>;
+        x[i] = y[i];
+        where(y < y, x) = y;
+    };
+
+    // a number is a scalar-like class type over a floating point value_type,
+    // such as autodiff::dual. it compares to bool like a float and brings its
+    // own exp, expm1, log1p, tanh and erfc found by adl, which the math functions
+    // call whatever the accuracy policy
+    template <typename T>
+    concept number = !pack<T> && std::floating_point<typename T::value_type> && requires (T x) {
+        { x + x } -> std::convertible_to<T>;
+        { x - x } -> std::convertible_to<T>;
+        { x*x } -> std::convertible_to<T>;
+        { x/x } -> std::convertible_to<T>;
+        { -x } -> std::convertible_to<T>;
+        { x < x } -> std::same_as<bool>;
+    };
+
+    template <typename T>
+    concept real = std::floating_point<T> || pack<T> || number<T>;
+
+    template <typename Mask, real T>
+    static constexpr T select (Mask const& mask, T const& a, T const& b) {
+        // mask ? a : b, lane by lane for packs. both a and b are evaluated
+        if constexpr (pack<T>) {
+            T r = b;
+            where(mask, r) = a;
+            return r;
+        } else {
+            return mask ? a : b;
+        }
+    }
+
+    template <real T>
+    static constexpr T literal (long double v) {
+        // v rounded to the element type of T, packs only broadcast from it
+        if constexpr (std::floating_point<T>) {
+            return static_cast<T>(v);
+        } else {
+            return T(static_cast<typename T::value_type>(v));
+        }
+    }
+
+    namespace math {
+        // branch-free replacements for the libm calls used by the activations.
+        // libm calls are opaque to the vectorizer, these are plain arithmetic
+        // and bit manipulation, so loops over contiguous data vectorize.
+        // float and double are accurate to a few ulp, other types use libm
+        // or their own overloads found by adl.
+
+        template <typename T>
+        concept vectorizable = std::same_as<T, float> || std::same_as<T, double>;
+
+        template <vectorizable T>
+        struct ieee;
+
+        template <>
+        struct ieee<float> {
+            using int_t = std::int32_t;
+            using uint_t = std::uint32_t;
+            static constexpr int mantissa = 23;
+            static constexpr int bias = 127;
+            // exp over-/underflow bounds
+            static constexpr float exp_hi = 88.72283935546875f;
+            static constexpr float exp_lo = -103.97208404541015625f;
+            // expm1(x) == -1 below, tanh(x) == 1 above
+            static constexpr float expm1_lo = -18.0f;
+            static constexpr float tanh_hi = 10.0f;
+            // softplus(x) == x and tanh(softplus(x)) == 1 above, exp(2x) finite
+            static constexpr float softplus_hi = 40.0f;
+            // exp(-x^2) underflows to 0 above, the center of the erfc map
+            static constexpr float erfc_hi = 10.5f;
+            static constexpr float erfc_k = 3.0f;
+            // Cody-Waite split of ln(2)
+            static constexpr float ln2_hi = 0.693359375f;
+            static constexpr float ln2_lo = -2.12194440e-4f;
+        };
+
+        template <>
+        struct ieee<double> {
+            using int_t = std::int64_t;
+            using uint_t = std::uint64_t;
+            static constexpr int mantissa = 52;
+            static constexpr int bias = 1023;
+            static constexpr double exp_hi = 709.782712893383973096;
+            static constexpr double exp_lo = -745.133219101941108420;
+            static constexpr double expm1_lo = -40.0;
+            static constexpr double tanh_hi = 20.0;
+            static constexpr double softplus_hi = 40.0;
+            static constexpr double erfc_hi = 30.0;
+            static constexpr double erfc_k = 4.0;
+            static constexpr double ln2_hi = 6.93147180369123816490e-01;
+            static constexpr double ln2_lo = 1.90821492927058770002e-10;
+        };
+
+        template <accuracy::policy Accuracy, vectorizable T>
+        struct degree {
+            // degrees of the minimax polynomials below, for exp and expm1 on
+            // [-ln2/2, ln2/2], atanh in log1p and erfc over its whole range.
+            // expm1 needs its error relative to r rather than to 1. the
+            // smallest that meet the bounds of the policy
+            static constexpr bool single = std::same_as<T, float>;
+            static constexpr bool fast = std::same_as<Accuracy, accuracy::fast>;
+            static constexpr bool ulp3 = std::same_as<Accuracy, accuracy::ulp3>;
+            static constexpr int exp = fast ? 4 : ulp3 ? (single ? 5 : 11) : (single ? 6 : 11);
+            static constexpr int expm1 = fast ? 4 : ulp3 ? (single ? 6 : 11) : (single ? 6 : 12);
+            static constexpr int atanh = fast ? 2 : single ? 3 : 7;
+            static constexpr int erfc = fast ? (single ? 6 : 8) : ulp3 ? (single ? 8 : 20) : (single ? 10 : 21);
+        };
+
+        template <vectorizable T>
+        static constexpr T pow2i (typename ieee<T>::int_t n) {
+            // 2^n by building the exponent field, n must be a normal exponent
+            using traits = ieee<T>;
+            using uint_t = typename traits::uint_t;
+            return std::bit_cast<T>(static_cast<uint_t>(n + traits::bias) << traits::mantissa);
+        }
+
+        template <vectorizable T>
+        static constexpr T copysign (T const& magnitude, T const& sign) {
+            using uint_t = typename ieee<T>::uint_t;
+            constexpr uint_t sign_bit = uint_t{1} << (sizeof(T)*8 - 1);
+            return std::bit_cast<T>((std::bit_cast<uint_t>(magnitude) & ~sign_bit)
+                                  | (std::bit_cast<uint_t>(sign) & sign_bit));
+        }
+
+        template <vectorizable T>
+        static constexpr T clamp (T const& x, T const& lo, T const& hi) {
+            // clamp on the bit pattern, mapped so that integer order is float
+            // order. integer min/max stay min/max instructions, whereas a
+            // float select against a constant is turned into a branch with
+            // the code after it specialized for the constant, which then no
+            // longer vectorizes. nan is passed through.
+            using int_t = typename ieee<T>::int_t;
+            constexpr int_t magnitude = std::numeric_limits<int_t>::max();
+            constexpr int_t inf = std::bit_cast<int_t>(std::numeric_limits<T>::infinity());
+            auto key = [](int_t b) -> int_t { return b ^ ((b >> (sizeof(T)*8 - 1)) & magnitude); };
+
+            int_t b = std::bit_cast<int_t>(x);
+            int_t k = std::min(std::max(key(b), key(std::bit_cast<int_t>(lo))), key(std::bit_cast<int_t>(hi)));
+            return std::bit_cast<T>((b & magnitude) > inf ? b : key(k));
+        }
+
+        template <vectorizable T>
+        static constexpr T select_positive (T const& x, T const& a, T const& b) {
+            // x > 0 ? a : b, on the bits for the same reason as clamp
+            using int_t = typename ieee<T>::int_t;
+            int_t mask = -int_t(std::bit_cast<int_t>(x) > 0);
+            return std::bit_cast<T>((std::bit_cast<int_t>(a) & mask) | (std::bit_cast<int_t>(b) & ~mask));
+        }
+
+        template <vectorizable T, std::size_t N>
+        static constexpr T horner (std::array<T, N> const& c, T const& x) {
+            // written out rather than looped, gcc stops unrolling at 16
+            // terms and a loop left in an elementwise kernel keeps it from
+            // vectorizing
+            return [&]<std::size_t... K>(std::index_sequence<K...>) {
+                T p = c[N - 1];
+                ((p = c[N - 2 - K] + x*p), ...);
+                return p;
+            }(std::make_index_sequence<N - 1>{});
+        }
+
+        namespace reference {
+            // long double versions of the functions the approximations are
+            // fitted to. plain series and loops, so the fitter below can run
+            // them at compile time. accurate to a few long double ulp on
+            // moderate arguments, which is all the fits need
+            constexpr long double ln2 = 0.693147180559945309417232121458176568L;
+            constexpr long double sqrt2 = 1.414213562373095048801688724209698079L;
+            constexpr long double pi = 3.141592653589793238462643383279502884L;
+
+            static constexpr long double expm1_quotient (long double x) {
+                // (exp(x) - 1)/x = sum x^k/(k + 1)!, for small |x|
+                long double sum = 0;
+                long double term = 1;
+                for (int k = 1; sum + term != sum; ++k) {
+                    sum += term;
+                    term *= x/(k + 1);
+                }
+                return sum;
+            }
+
+            static constexpr long double exp (long double x) {
+                // exp(r)*2^n, x = n*ln2 + r
+                long long n = static_cast<long long>(x/ln2 + (x < 0 ? -0.5L : 0.5L));
+                long double r = x - n*ln2;
+                long double e = 1 + r*expm1_quotient(r);
+                for (; n > 0; --n) e *= 2;
+                for (; n < 0; ++n) e /= 2;
+                return e;
+            }
+
+            static constexpr long double expm1 (long double x) {
+                return x > -0.5L && x < 0.5L ? x*expm1_quotient(x) : exp(x) - 1;
+            }
+
+            static constexpr long double atanh_quotient (long double z) {
+                // atanh(sqrt(z))/sqrt(z) = sum z^k/(2k + 1), for small z
+                long double sum = 0;
+                long double power = 1;
+                long double term = 1;
+                for (int k = 1; sum + term != sum; ++k) {
+                    sum += term;
+                    power *= z;
+                    term = power/(2*k + 1);
+                }
+                return sum;
+            }
+
+            static constexpr long double atanh_tail (long double z) {
+                // (atanh_quotient(z) - 1)/z = sum z^k/(2k + 3)
+                long double sum = 0;
+                long double power = 1;
+                long double term = 1.0L/3;
+                for (int k = 1; sum + term != sum; ++k) {
+                    sum += term;
+                    power *= z;
+                    term = power/(2*k + 3);
+                }
+                return sum;
+            }
+
+            static constexpr long double log1p (long double x) {
+                // 2*atanh(s), s = x/(2 + x), after scaling 1 + x into
+                // [sqrt(1/2), sqrt(2)) by powers of two
+                int k = 0;
+                long double m = 1 + x;
+                for (; m >= sqrt2; m /= 2) ++k;
+                for (; m < 1/sqrt2; m *= 2) --k;
+                long double f = k == 0 ? x : m - 1;
+                long double s = f/(2 + f);
+                return k*ln2 + 2*s*atanh_quotient(s*s);
+            }
+
+            static constexpr long double tanh (long double x) {
+                long double e = expm1(2*(x < 0 ? -x : x));
+                long double t = e/(e + 2);
+                return x < 0 ? -t : t;
+            }
+
+            static constexpr long double sigmoid (long double x) {
+                return 1/(1 + exp(-x));
+            }
+
+            static constexpr long double softplus (long double x) {
+                return x > 0 ? x + log1p(exp(-x)) : log1p(exp(x));
+            }
+
+            static constexpr long double erfcx (long double x) {
+                // exp(x^2)*erfc(x) for x >= 0. below 2 from the series of
+                // erf with positive terms, above from the continued fraction
+                // of erfc, 50 terms are exact to long double there
+                constexpr long double rsqrtpi = 0.564189583547756286948079451560772586L;
+                if (x < 2) {
+                    long double sum = 0;
+                    long double term = x;
+                    for (int k = 0; sum + term != sum; ++k) {
+                        sum += term;
+                        term *= 2*x*x/(2*k + 3);
+                    }
+                    return exp(x*x) - 2*rsqrtpi*sum;
+                }
+                long double fraction = 2*x*x + 1 + 4*50;
+                for (int k = 50; k >= 1; --k) {
+                    fraction = 2*x*x + 1 + 4*(k - 1) - (long double)(2*k - 1)*(2*k)/fraction;
+                }
+                return 2*x*rsqrtpi/fraction;
+            }
+
+            static constexpr long double cos (long double x) {
+                // for |x| <= pi
+                long double sum = 0;
+                long double term = 1;
+                for (int k = 0; sum + term != sum; ++k) {
+                    sum += term;
+                    term *= -x*x/((2*k + 1)*(2*k + 2));
+                }
+                return sum;
+            }
+        }
+
+        template <int Degree>
+        struct fit {
+            // power basis coefficients, c[k] multiplies x^k, and the max
+            // error over the interval, relative when fitted relative
+            std::array<long double, Degree + 1> c;
+            long double error;
+        };
+
+        template <int Degree, int Density = 64, typename F>
+        static constexpr fit<Degree> remez (F f, long double a, long double b, bool relative = true) {
+            // minimax polynomial of f on [a, b] by the Remez exchange. f and
+            // the weight are sampled once on a grid of Density points per
+            // coefficient, the reference points
+            // are grid points and every exchange moves them to the alternating
+            // extrema of the error on the grid. starts at the Chebyshev extrema
+            // and stops once the extrema are level to 0.1%, or after 16
+            // exchanges when long double rounding keeps them from levelling
+            constexpr int n = Degree + 2;
+            constexpr int grid = Density*n;
+            auto abs = [](long double x) { return x < 0 ? -x : x; };
+
+            std::array<long double, grid + 1> x{}, y{}, w{}, error{};
+            for (int i = 0; i <= grid; ++i) {
+                x[i] = a + (b - a)*i/grid;
+                y[i] = f(x[i]);
+                w[i] = relative ? abs(y[i]) : 1;
+            }
+
+            std::array<int, grid + 1> points{};
+            for (int i = 0; i < n; ++i) {
+                points[i] = static_cast<int>(grid*(1 - reference::cos(reference::pi*i/(n - 1)))/2 + 0.5L);
+            }
+
+            fit<Degree> best{{}, std::numeric_limits<long double>::max()};
+            for (int iteration = 0; iteration < 16; ++iteration) {
+                // p(x_i) + (-1)^i*level*w(x_i) = f(x_i), gaussian elimination
+                std::array<std::array<long double, n + 1>, n> m{};
+                for (int i = 0; i < n; ++i) {
+                    long double power = 1;
+                    for (int j = 0; j <= Degree; ++j, power *= x[points[i]]) {
+                        m[i][j] = power;
+                    }
+                    m[i][n - 1] = (i % 2 ? -1 : 1)*w[points[i]];
+                    m[i][n] = y[points[i]];
+                }
+                for (int col = 0; col < n; ++col) {
+                    int pivot = col;
+                    for (int r = col + 1; r < n; ++r) {
+                        if (abs(m[r][col]) > abs(m[pivot][col])) pivot = r;
+                    }
+                    std::swap(m[col], m[pivot]);
+                    for (int r = col + 1; r < n; ++r) {
+                        long double factor = m[r][col]/m[col][col];
+                        for (int k = col; k <= n; ++k) m[r][k] -= factor*m[col][k];
+                    }
+                }
+                std::array<long double, n> solution{};
+                for (int r = n - 1; r >= 0; --r) {
+                    long double s = m[r][n];
+                    for (int k = r + 1; k < n; ++k) s -= m[r][k]*solution[k];
+                    solution[r] = s/m[r][r];
+                }
+
+                fit<Degree> current{{}, 0};
+                for (int j = 0; j <= Degree; ++j) current.c[j] = solution[j];
+                for (int i = 0; i <= grid; ++i) {
+                    long double p = current.c[Degree];
+                    for (int j = Degree; j-- > 0;) p = current.c[j] + x[i]*p;
+                    error[i] = (p - y[i])/w[i];
+                    current.error = std::max(current.error, abs(error[i]));
+                }
+                if (current.error < best.error) {
+                    best = current;
+                }
+
+                // one extremum per run of equal sign, then trimmed at the
+                // ends down to n, keeping the larger end each time
+                int count = 0;
+                for (int i = 0; i <= grid; ++i) {
+                    if (count > 0 && (error[i] < 0) == (error[points[count - 1]] < 0)) {
+                        if (abs(error[i]) > abs(error[points[count - 1]])) points[count - 1] = i;
+                    } else {
+                        points[count++] = i;
+                    }
+                }
+                if (count < n) {
+                    break;
+                }
+                int first = 0;
+                for (; count > n; --count) {
+                    if (abs(error[points[first]]) < abs(error[points[first + count - 1]])) ++first;
+                }
+                for (int i = 0; i < n; ++i) {
+                    points[i] = points[first + i];
+                }
+
+                if (current.error - abs(solution[n - 1]) <= current.error*1e-3L) {
+                    break;
+                }
+            }
+            return best;
+        }
+
+        template <vectorizable T, int Degree, int Density = 64, typename F>
+        static constexpr std::array<T, Degree + 1> minimax (F f, long double a, long double b, bool relative = true) {
+            // remez rounded to T, e.g. a table for tanh on [0, 1/2]
+            //   constexpr auto c = math::minimax<float, 7>(math::reference::tanh, 0.0L, 0.5L, false);
+            auto fitted = remez<Degree, Density>(f, a, b, relative);
+            std::array<T, Degree + 1> c{};
+            for (int k = 0; k <= Degree; ++k) c[k] = static_cast<T>(fitted.c[k]);
+            return c;
+        }
+
+        template <vectorizable T, int Degree>
+        static constexpr auto expm1_coefficients = minimax<T, Degree - 1>(reference::expm1_quotient, -reference::ln2/2, reference::ln2/2);
+
+        template <vectorizable T, int Degree>
+        static constexpr auto atanh_coefficients = [] {
+            // atanh(s)/s = 1 + z*p(z) with z = s^2, the table is p, on [0, s^2]
+            // for the largest |s| = (sqrt(2) - 1)/(sqrt(2) + 1)
+            constexpr long double s = (reference::sqrt2 - 1)/(reference::sqrt2 + 1);
+            return minimax<T, Degree - 1>(reference::atanh_tail, 0.0L, s*s);
+        }();
+
+        template <vectorizable T, int Degree>
+        static constexpr auto erfc_coefficients = [] {
+            // erfc(x) = exp(-x^2)*p(s)/(1 + 2x), s = (x - k)/(x + k) maps x in
+            // [0, inf) to [-1, 1), after Shepherd and Laframboise. p fits
+            // (1 + 2x)*exp(x^2)*erfc(x) from 0 to where erfc underflows, on
+            // a coarser grid, at these degrees the full one does not fit
+            // the compile time evaluation limits
+            constexpr long double k = ieee<T>::erfc_k;
+            constexpr long double hi = ieee<T>::erfc_hi;
+            auto f = [](long double s) {
+                long double x = k*(1 + s)/(1 - s);
+                return (1 + 2*x)*reference::erfcx(x);
+            };
+            return minimax<T, Degree, 16>(f, -1.0L, (hi - k)/(hi + k));
+        }();
+
+        template <accuracy::policy Accuracy, vectorizable T, int Degree = degree<Accuracy, T>::expm1>
+        static constexpr T expm1_poly (T const& r) {
+            // exp(r) - 1 as r times the minimax polynomial of (exp(r) - 1)/r
+            return r*horner(expm1_coefficients<T, Degree>, r);
+        }
+
+        template <vectorizable T>
+        struct reduced {
+            T r;
+            typename ieee<T>::int_t n;
+        };
+
+        template <vectorizable T>
+        static constexpr reduced<T> reduce_ln2 (T const& x) {
+            // x = n*ln2 + r, |r| <= ln2/2
+            // adding the shifter rounds to an integer held in the low bits
+            using traits = ieee<T>;
+            using int_t = typename traits::int_t;
+            constexpr T log2e = T{1.44269504088896340736};
+            constexpr T shifter = T{1.5}*pow2i<T>(traits::mantissa);
+
+            T kf = x*log2e + shifter;
+            int_t n = std::bit_cast<int_t>(kf) - std::bit_cast<int_t>(shifter);
+            kf -= shifter;
+            T r = (x - kf*traits::ln2_hi) - kf*traits::ln2_lo;
+            return {r, n};
+        }
+
+        template <vectorizable T>
+        static constexpr std::pair<T, T> square (T const& x) {
+            // x*x = hi + lo exactly, Dekker's product on a Veltkamp split of x
+            constexpr T split = pow2i<T>((ieee<T>::mantissa + 2)/2) + T{1};
+            T c = split*x;
+            T xh = c - (c - x);
+            T xl = x - xh;
+            T hi = x*x;
+            T lo = ((xh*xh - hi) + T{2}*xh*xl) + xl*xl;
+            return {hi, lo};
+        }
+
+        template <pack T, typename F>
+        static constexpr T lanewise (T const& x, F f) {
+            // the approximations work on the bits of a single value, packs
+            // run them lane by lane. the exact policy calls the pack's own
+            // math functions instead
+            T y = x;
+            for (std::size_t i = 0; i < T::size(); ++i) {
+                y[i] = f(x[i]);
+            }
+            return y;
+        }
+
+        template <accuracy::policy Accuracy = accuracy::ulp1, real T>
+        static constexpr T exp (T const& x) {
+            if constexpr (pack<T> && !std::same_as<Accuracy, accuracy::exact>) {
+                return math::lanewise(x, [](auto v) { return math::exp<Accuracy>(v); });
+            } else if constexpr (!vectorizable<T> || std::same_as<Accuracy, accuracy::exact>) {
+                using std::exp;
+                return exp(x);
+            } else {
+                using traits = ieee<T>;
+                // special cases scale the core result rather than replace it,
+                // so the core is never moved under a branch. below the range
+                // the core runs on 0, at exp_lo it would make a subnormal,
+                // which costs a microcode assist per lane
+                T in_range = x < traits::exp_lo ? T{0} : T{1};
+                T special = x > traits::exp_hi ? std::numeric_limits<T>::infinity() : in_range;
+
+                auto [r, n] = reduce_ln2(math::clamp(x, traits::exp_lo, traits::exp_hi)*in_range);
+                // scale in two steps, 2^n alone leaves the exponent range at the ends
+                auto n1 = n >> 1;
+                return (T{1} + expm1_poly<Accuracy, T, degree<Accuracy, T>::exp>(r))*pow2i<T>(n1)*pow2i<T>(n - n1)*special;
+            }
+        }
+
+        template <accuracy::policy Accuracy = accuracy::ulp1, real T>
+        static constexpr T expm1 (T const& x) {
+            if constexpr (pack<T> && !std::same_as<Accuracy, accuracy::exact>) {
+                return math::lanewise(x, [](auto v) { return math::expm1<Accuracy>(v); });
+            } else if constexpr (!vectorizable<T> || std::same_as<Accuracy, accuracy::exact>) {
+                using std::expm1;
+                return expm1(x);
+            } else {
+                using traits = ieee<T>;
+                // expm1 rounds to -1 at the lower bound already
+                T special = x > traits::exp_hi ? std::numeric_limits<T>::infinity() : T{1};
+
+                auto [r, n] = reduce_ln2(math::clamp(x, traits::expm1_lo, traits::exp_hi));
+                auto n1 = n >> 1;
+                T s1 = pow2i<T>(n1);
+                T s2 = pow2i<T>(n - n1);
+                T p = expm1_poly<Accuracy>(r);
+                // 2^n*(1 + p) - 1 without cancellation when n is small,
+                // the -1 is below rounding once 2^n outgrows the mantissa
+                T s = s1*s2;
+                T y = n > traits::mantissa + 1 ? ((T{1} + p)*s1)*s2 : p*s + (s - T{1});
+                return y*special;
+            }
+        }
+
+        template <accuracy::policy Accuracy = accuracy::ulp1, real T>
+        static constexpr T log1p (T const& x) {
+            if constexpr (pack<T> && !std::same_as<Accuracy, accuracy::exact>) {
+                return math::lanewise(x, [](auto v) { return math::log1p<Accuracy>(v); });
+            } else if constexpr (!vectorizable<T> || std::same_as<Accuracy, accuracy::exact>) {
+                using std::log1p;
+                return log1p(x);
+            } else {
+                using traits = ieee<T>;
+                using int_t = typename traits::int_t;
+                using uint_t = typename traits::uint_t;
+                constexpr uint_t one = std::bit_cast<uint_t>(T{1});
+                constexpr uint_t sqrt_half = std::bit_cast<uint_t>(T{0.70710678118654752440});
+                constexpr uint_t mantissa_mask = (uint_t{1} << traits::mantissa) - 1;
+
+                // as in exp the special cases are added to the core result,
+                // which runs on an argument clamped into its domain
+                constexpr T inf = std::numeric_limits<T>::infinity();
+                constexpr T max = std::numeric_limits<T>::max();
+                T special = x > max ? inf : T{0};
+                special = x <= T{-1} ? -inf : special;
+                special = x < T{-1} ? std::numeric_limits<T>::quiet_NaN() : special;
+                T xs = math::clamp(x, T{-1} + std::numeric_limits<T>::epsilon()/2, max);
+
+                T u = T{1} + xs;
+                // u = m*2^k, m in [sqrt(1/2), sqrt(2)), m is normal for any u
+                uint_t ub = std::bit_cast<uint_t>(u) + (one - sqrt_half);
+                int_t k = static_cast<int_t>(ub >> traits::mantissa) - traits::bias;
+                T m = std::bit_cast<T>((ub & mantissa_mask) + sqrt_half);
+                T kf = static_cast<T>(k);
+
+                // log(m) = 2*atanh(s) = 2s + s*r, s = (m - 1)/(m + 1), with
+                // 2s = f - s*f = f - (h - s*h) for f = m - 1 and h = f^2/2,
+                // as in fdlibm. f is exact, only the small correction
+                // h - s*(h + r) is rounded, not the whole of 2s
+                T f = m - T{1};
+                T s = f/(T{2} + f);
+                T z = s*s;
+                T h = T{0.5}*f*f;
+                T r = T{2}*z*horner(atanh_coefficients<T, degree<Accuracy, T>::atanh>, z);
+                // rounding error of 1 + x relative to u, 1/u = 2^-k/m stays
+                // finite where u is huge
+                T c = (xs - (u - T{1}))*pow2i<T>(-std::min<int_t>(k, traits::bias - 1))/m;
+                T y = kf*traits::ln2_hi + (f - (h - (s*(h + r) + (kf*traits::ln2_lo + c))));
+                return y + special;
+            }
+        }
+
+        template <accuracy::policy Accuracy = accuracy::ulp1, real T>
+        static constexpr T tanh (T const& x) {
+            if constexpr (pack<T> && !std::same_as<Accuracy, accuracy::exact>) {
+                return math::lanewise(x, [](auto v) { return math::tanh<Accuracy>(v); });
+            } else if constexpr (!vectorizable<T> || std::same_as<Accuracy, accuracy::exact>) {
+                using std::tanh;
+                return tanh(x);
+            } else {
+                // tanh(|x|) = e/(e + 2), e = expm1(2|x|)
+                T ax = math::clamp(x < T{0} ? -x : x, T{0}, ieee<T>::tanh_hi);
+                T e = math::expm1<Accuracy>(2*ax);
+                return math::copysign(e/(e + T{2}), x);
+            }
+        }
+
+        template <accuracy::policy Accuracy = accuracy::ulp1, real T>
+        static constexpr T erfc (T const& x) {
+            if constexpr (pack<T> && !std::same_as<Accuracy, accuracy::exact>) {
+                return math::lanewise(x, [](auto v) { return math::erfc<Accuracy>(v); });
+            } else if constexpr (!vectorizable<T> || std::same_as<Accuracy, accuracy::exact>) {
+                using std::erfc;
+                return erfc(x);
+            } else {
+                // erfc(|x|) from the table above, with one division for both
+                // s and 1/(1 + 2|x|). x^2 is split exactly so exp(-x^2) keeps
+                // its accuracy in the tail, exp(-lo) = 1 - lo at that size.
+                // erfc(-|x|) = 2 - erfc(|x|), applied multiplicatively
+                constexpr T k = ieee<T>::erfc_k;
+                T a = math::clamp(x < T{0} ? -x : x, T{0}, ieee<T>::erfc_hi);
+                T d = T{1}/((a + k)*(T{1} + T{2}*a));
+                T s = (a - k)*(T{1} + T{2}*a)*d;
+                auto [hi, lo] = math::square(a);
+                T e = math::exp<Accuracy>(-hi)*(T{1} - lo);
+                T r = e*horner(erfc_coefficients<T, degree<Accuracy, T>::erfc>, s)*((a + k)*d);
+                T negative = x < T{0} ? T{1} : T{0};
+                return T{2}*negative + r*(T{1} - T{2}*negative);
+            }
+        }
+
+        template <real T>
+        static constexpr T softplus_cap (T const& x) {
+            // min(x, softplus_hi), past it softplus is linear
+            if constexpr (vectorizable<T>) {
+                return math::clamp(x, -std::numeric_limits<T>::infinity(), ieee<T>::softplus_hi);
+            } else {
+                using std::min;
+                return min(x, literal<T>(ieee<double>::softplus_hi));
+            }
+        }
+
+        template <accuracy::policy Accuracy = accuracy::ulp1, real T>
+        static constexpr T softplus (T const& x) {
+            if constexpr (pack<T> && !std::same_as<Accuracy, accuracy::exact>) {
+                return math::lanewise(x, [](auto v) { return math::softplus<Accuracy>(v); });
+            } else {
+                // log(1 + exp(x)) = max(x, 0) + log1p(exp(-|x|)), exp never
+                // overflows. the cap keeps exp(-|x|) out of the subnormals
+                // for large x, where the log1p term is below rounding anyway
+                using std::max, std::abs;
+                return max(x, T{0}) + math::log1p<Accuracy>(math::exp<Accuracy>(-abs(math::softplus_cap(x))));
+            }
+        }
+    }
+
+    namespace kernel {
+        // elementwise loops over contiguous memory. the same loop is compiled
+        // once per instruction set and the widest one the cpu supports is
+        // picked at runtime. on aarch64 neon is baseline, the generic loop
+        // is already vectorized there. the loops turn on the vectorizer
+        // themselves, at -O2 gcc only vectorizes loops with no runtime
+        // checks, which leaves out nearly every loop here.
+        enum class isa { generic, avx2, avx512 };
+
+        static isa detect () {
+        #if defined(__x86_64__) || defined(__i386__)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+                return isa::avx512;
+            }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                return isa::avx2;
+            }
+        #endif
+            return isa::generic;
+        }
+
+        static isa selected () {
+            static isa const s = detect();
+            return s;
+        }
+
+        template <typename F>
+        [[gnu::flatten, gnu::optimize("tree-vectorize")]]
+        static void loop_generic (std::size_t n, F f) {
+            for (std::size_t i = 0; i < n; ++i) f(i);
+        }
+
+    #if defined(__x86_64__) || defined(__i386__)
+        template <typename F>
+        [[gnu::target("avx2,fma"), gnu::flatten, gnu::optimize("tree-vectorize")]]
+        static void loop_avx2 (std::size_t n, F f) {
+            for (std::size_t i = 0; i < n; ++i) f(i);
+        }
+
+        template <typename F>
+        [[gnu::target("avx512f,avx512dq"), gnu::flatten, gnu::optimize("tree-vectorize")]]
+        static void loop_avx512 (std::size_t n, F f) {
+            for (std::size_t i = 0; i < n; ++i) f(i);
+        }
+    #endif
+
+        template <typename F>
+        static void loop (std::size_t n, F f) {
+            // f(i) for i in [0, n), f must be inlinable and branch-free
+            switch (selected()) {
+            #if defined(__x86_64__) || defined(__i386__)
+                case isa::avx512: return loop_avx512(n, f);
+                case isa::avx2: return loop_avx2(n, f);
+            #endif
+                default: return loop_generic(n, f);
+            }
+        }
+
+        template <typename T, typename F>
+        static void map (std::span<T const> in, std::span<T> out, F f) {
+            // out[i] = f(in[i]), in and out may be the same buffer
+            assert(out.size() >= in.size());
+            T const* x = in.data();
+            T* y = out.data();
+            loop(in.size(), [=](std::size_t i) { y[i] = f(x[i]); });
+        }
+
+        template <typename T, typename F>
+        static void map (std::span<T const> in, std::span<T> out, std::span<T> out2, F f) {
+            // f returns a pair, first goes to out and second to out2
+            assert(out.size() >= in.size() && out2.size() >= in.size());
+            T const* x = in.data();
+            T* y = out.data();
+            T* y2 = out2.data();
+            loop(in.size(), [=](std::size_t i) {
+                auto [v, v2] = f(x[i]);
+                y[i] = v;
+                y2[i] = v2;
+            });
+        }
+
+        template <typename T, typename F>
+        static T sum (std::size_t n, F f) {
+            // f(0) + ... + f(n - 1) in 16 interleaved partial sums. a single
+            // running sum is a serial chain the vectorizer may not reorder,
+            // the partials are independent lanes. the terms keep the type f
+            // returns and are converted to T as they're added, so float
+            // terms into double partials are vector converts
+            using V = std::invoke_result_t<F, std::size_t>;
+            constexpr std::size_t lanes = 16;
+            std::array<T, lanes> partial{};
+            T* p = partial.data();
+            loop(n/lanes, [=](std::size_t block) {
+                V v[lanes];
+                for (std::size_t j = 0; j < lanes; ++j) v[j] = f(block*lanes + j);
+                for (std::size_t j = 0; j < lanes; ++j) p[j] += T(v[j]);
+            });
+            T total{0};
+            for (std::size_t i = n - n % lanes; i < n; ++i) total += T(f(i));
+            for (T v : partial) total += v;
+            return total;
+        }
+
+        template <typename T, typename F>
+        static T max (std::size_t n, F f) {
+            // the largest f(i), -inf for n = 0, in 16 running maxima as sum
+            // keeps its partials. nans are skipped
+            constexpr std::size_t lanes = 16;
+            std::array<T, lanes> partial;
+            partial.fill(-std::numeric_limits<T>::infinity());
+            T* p = partial.data();
+            loop(n/lanes, [=](std::size_t block) {
+                for (std::size_t j = 0; j < lanes; ++j) {
+                    T v = f(block*lanes + j);
+                    p[j] = v > p[j] ? v : p[j];
+                }
+            });
+            T largest = -std::numeric_limits<T>::infinity();
+            for (std::size_t i = n - n % lanes; i < n; ++i) {
+                T v = f(i);
+                largest = v > largest ? v : largest;
+            }
+            for (T v : partial) largest = v > largest ? v : largest;
+            return largest;
+        }
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T sigmoid (T const& z) {
+        // bad for activation due to vanishing gradient
+        // okay for gating functions
+        return T{1}/(T{1}+math::exp<Accuracy>(-z));
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T sigmoid_grad (T const& z) {
+        T s = activation::sigmoid<T, Accuracy>(z);
+        return s*(T{1} - s);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T tanh (T const& z) {
+        // zero-centered (better than sigmoid)
+        // used in recurrent nn and lstm
+        return math::tanh<Accuracy>(z);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T tanh_grad (T const& z) {
+        T t = activation::tanh<T, Accuracy>(z);
+        return T{1} - t*t;
+    }
+
+    template <real T>
+    static constexpr T relu (T const& z) {
+        // most popular, best performance in cnn
+        using std::max;
+        return max(T{0}, z);
+    }
+
+    template <real T>
+    static constexpr T relu_grad (T const& z) {
+        return activation::select(z > T{0}, T{1}, T{0});
+    }
+
+    template <real T>
+    static constexpr T prelu (T const& z, std::type_identity_t<T> const& alpha) {
+        // parameteric relu
+        return activation::select(z > T{0}, z, z*alpha);
+    }
+
+    template <real T>
+    static constexpr T prelu_grad (T const& z, std::type_identity_t<T> const& alpha) {
+        return activation::select(z > T{0}, T{1}, alpha);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T elu (T const& z, std::type_identity_t<T> const& alpha) {
+        // exponentially linear unit
+        return activation::select(z > T{0}, z, alpha*math::expm1<Accuracy>(z));
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T elu_grad (T const& z, std::type_identity_t<T> const& alpha) {
+        return activation::select(z > T{0}, T{1}, alpha*math::exp<Accuracy>(z));
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T glu (T const& z) {
+        // z*sigmoid(z), the gate applied to its own input, so the same
+        // function as swish. the gated linear unit over separate value and
+        // gate halves is gated::glu below
+        return z*activation::sigmoid<T, Accuracy>(z);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T glu_grad (T const& z) {
+        T s = activation::sigmoid<T, Accuracy>(z);
+        return s + z*s*(T{1} - s);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T swish (T const& z) {
+        // sparsity, no saturation
+        // small negativesa are not zero'd out
+        return activation::glu<T, Accuracy>(z);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T swish_grad (T const& z) {
+        return activation::glu_grad<T, Accuracy>(z);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T softplus (T const& z, std::type_identity_t<T> const& beta) {
+        return math::softplus<Accuracy>(z*beta)/beta;
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T softplus_grad (T const& z, std::type_identity_t<T> const& beta) {
+        return activation::sigmoid<T, Accuracy>(z*beta);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T mish (T const& z) {
+        // no saturation, continuous
+        // small negativesa are not zero'd out
+        // tanh(softplus(z)) = n/(n + 2) with n = w*(w + 2), w = exp(z), one
+        // exp instead of exp, log1p and tanh. the ratio is 1 past the cap
+        T w = math::exp<Accuracy>(math::softplus_cap(z));
+        T n = w*(w + T{2});
+        return z*(n/(n + T{2}));
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T mish_grad (T const& z) {
+        // 1 - t^2 = 2(1 + t)/(n + 2) and sigmoid(z) = w/(1 + w). that term
+        // is below rounding past the cap, where it takes the capped z too
+        T c = math::softplus_cap(z);
+        T w = math::exp<Accuracy>(c);
+        T n = w*(w + T{2});
+        T r = T{1}/(n + T{2});
+        T t = n*r;
+        return t + c*T{2}*r*(T{1} + t)*w/(T{1} + w);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T gelu (T const& z) {
+        // gaussian error linear unit z*P(Z <= z), transformers
+        // erfc keeps the negative tail accurate where 1 + erf cancels
+        return z*math::erfc<Accuracy>(-z*literal<T>(0.707106781186547524400844362104849039L))/T{2};
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T gelu_grad (T const& z) {
+        T phi = math::exp<Accuracy>(-z*z/T{2})*literal<T>(0.398942280401432677939946059934381868L);
+        return math::erfc<Accuracy>(-z*literal<T>(0.707106781186547524400844362104849039L))/T{2} + z*phi;
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T gelu_tanh (T const& z) {
+        // the tanh approximation of gelu as in bert and gpt-2,
+        // 0.5*z*(1 + tanh(u)) is z*sigmoid(2u)
+        T u = literal<T>(0.797884560802865355879892119868763737L)*(z + literal<T>(0.044715L)*z*z*z);
+        return z/(T{1} + math::exp<Accuracy>(T{-2}*u));
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T gelu_tanh_grad (T const& z) {
+        T u = literal<T>(0.797884560802865355879892119868763737L)*(z + literal<T>(0.044715L)*z*z*z);
+        T du = literal<T>(0.797884560802865355879892119868763737L)*(T{1} + literal<T>(0.134145L)*z*z);
+        T s = T{1}/(T{1} + math::exp<Accuracy>(T{-2}*u));
+        return s + T{2}*z*du*s*(T{1} - s);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T silu (T const& z) {
+        // sigmoid linear unit, the same function as swish
+        return activation::glu<T, Accuracy>(z);
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T silu_grad (T const& z) {
+        return activation::glu_grad<T, Accuracy>(z);
+    }
+
+    template <real T>
+    static constexpr T hard_sigmoid (T const& z) {
+        // piecewise linear sigmoid, relu6(z + 3)/6, mobilenet v3
+        using std::min, std::max;
+        return min(max(z + T{3}, T{0}), T{6})/T{6};
+    }
+
+    template <real T>
+    static constexpr T hard_sigmoid_grad (T const& z) {
+        return activation::select(z > T{-3} && z < T{3}, T{1}/T{6}, T{0});
+    }
+
+    template <real T>
+    static constexpr T hard_swish (T const& z) {
+        // z*hard_sigmoid(z), swish without the exp
+        return z*activation::hard_sigmoid(z);
+    }
+
+    template <real T>
+    static constexpr T hard_swish_grad (T const& z) {
+        return activation::select(z < T{-3}, T{0}, activation::select(z > T{3}, T{1}, z/T{3} + literal<T>(0.5L)));
+    }
+
+    template <real T>
+    static constexpr T leaky_relu (T const& z, std::type_identity_t<T> const& alpha = literal<T>(0.01L)) {
+        // prelu with a fixed small slope
+        return activation::prelu(z, alpha);
+    }
+
+    template <real T>
+    static constexpr T leaky_relu_grad (T const& z, std::type_identity_t<T> const& alpha = literal<T>(0.01L)) {
+        return activation::prelu_grad(z, alpha);
+    }
+
+    // the self-normalizing fixed point of selu, Klambauer et al.
+    constexpr long double selu_lambda = 1.05070098735548049341933498529460727L;
+    constexpr long double selu_alpha = 1.67326324235437728481704299167172045L;
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T selu (T const& z) {
+        // scaled elu, keeps activations at zero mean and unit variance
+        return literal<T>(selu_lambda)*activation::elu<T, Accuracy>(z, literal<T>(selu_alpha));
+    }
+
+    template <real T, accuracy::policy Accuracy = accuracy::exact>
+    static constexpr T selu_grad (T const& z) {
+        return literal<T>(selu_lambda)*activation::elu_grad<T, Accuracy>(z, literal<T>(selu_alpha));
+    }
+
+    template <real T>
+    static constexpr T softsign (T const& z) {
+        // tanh-like, saturates polynomially
+        using std::abs;
+        return z/(T{1} + abs(z));
+    }
+
+    template <real T>
+    static constexpr T softsign_grad (T const& z) {
+        using std::abs;
+        T d = T{1} + abs(z);
+        return T{1}/(d*d);
+    }
+
+    // batch kernels over contiguous spans, out-of-place and in-place.
+    // the bodies mirror the scalar functions above with the libm calls
+    // swapped for activation::math so the loops vectorize. the kernels
+    // built on exp/tanh take an accuracy policy, ulp1 by default, e.g.
+    // activation::mish<float, activation::accuracy::fast>(in, out)
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void sigmoid (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return T{1}/(T{1} + math::exp<Accuracy>(-z)); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void sigmoid (std::span<T> z) {
+        activation::sigmoid<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void tanh (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return math::tanh<Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void tanh (std::span<T> z) {
+        activation::tanh<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T>
+    static void relu (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::relu(z); });
+    }
+
+    template <std::floating_point T>
+    static void relu (std::span<T> z) {
+        activation::relu<T>(z, z);
+    }
+
+    template <std::floating_point T>
+    static void prelu (std::span<T const> in, std::span<T> out, T const& alpha) {
+        kernel::map(in, out, [alpha](T z) { return activation::prelu(z, alpha); });
+    }
+
+    template <std::floating_point T>
+    static void prelu (std::span<T> z, T const& alpha) {
+        activation::prelu<T>(z, z, alpha);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void elu (std::span<T const> in, std::span<T> out, T const& alpha) {
+        kernel::map(in, out, [alpha](T z) { return activation::elu<T, Accuracy>(z, alpha); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void elu (std::span<T> z, T const& alpha) {
+        activation::elu<T, Accuracy>(z, z, alpha);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void glu (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return z/(T{1} + math::exp<Accuracy>(-z)); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void glu (std::span<T> z) {
+        activation::glu<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void swish (std::span<T const> in, std::span<T> out) {
+        activation::glu<T, Accuracy>(in, out);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void swish (std::span<T> z) {
+        activation::glu<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void softplus (std::span<T const> in, std::span<T> out, T const& beta) {
+        kernel::map(in, out, [beta](T z) { return math::softplus<Accuracy>(z*beta)/beta; });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void softplus (std::span<T> z, T const& beta) {
+        activation::softplus<T, Accuracy>(z, z, beta);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void mish (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::mish<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void mish (std::span<T> z) {
+        activation::mish<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::gelu<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu (std::span<T> z) {
+        activation::gelu<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu_tanh (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::gelu_tanh<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu_tanh (std::span<T> z) {
+        activation::gelu_tanh<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void silu (std::span<T const> in, std::span<T> out) {
+        activation::glu<T, Accuracy>(in, out);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void silu (std::span<T> z) {
+        activation::glu<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T>
+    static void hard_sigmoid (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::hard_sigmoid(z); });
+    }
+
+    template <std::floating_point T>
+    static void hard_sigmoid (std::span<T> z) {
+        activation::hard_sigmoid<T>(z, z);
+    }
+
+    template <std::floating_point T>
+    static void hard_swish (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::hard_swish(z); });
+    }
+
+    template <std::floating_point T>
+    static void hard_swish (std::span<T> z) {
+        activation::hard_swish<T>(z, z);
+    }
+
+    template <std::floating_point T>
+    static void leaky_relu (std::span<T const> in, std::span<T> out, T const& alpha = T(0.01)) {
+        activation::prelu<T>(in, out, alpha);
+    }
+
+    template <std::floating_point T>
+    static void leaky_relu (std::span<T> z, T const& alpha = T(0.01)) {
+        activation::prelu<T>(z, z, alpha);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void selu (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::selu<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void selu (std::span<T> z) {
+        activation::selu<T, Accuracy>(z, z);
+    }
+
+    template <std::floating_point T>
+    static void softsign (std::span<T const> in, std::span<T> out) {
+        kernel::map(in, out, [](T z) { return activation::softsign(z); });
+    }
+
+    template <std::floating_point T>
+    static void softsign (std::span<T> z) {
+        activation::softsign<T>(z, z);
+    }
+
+    // derivatives over spans. *_grad writes f'(z). *_forward writes f(z) and
+    // f'(z) from the same exp/tanh evaluation, the saved f'(z) is all the
+    // backward pass needs, see backward below.
+
+    namespace {
+        template <std::floating_point T>
+        static constexpr T logistic (T const& e) {
+            // e/(1 + e) for e = exp(x), without inf/inf when exp overflows
+            T r = T{1}/(T{1} + e);
+            return e > T{1} ? T{1} - r : e*r;
+        }
+
+        template <std::floating_point T>
+        static constexpr T logistic (T const& x, T const& e) {
+            // sigmoid(x) from e = exp(-|x|), 1/(1 + e) or e/(1 + e) by the
+            // sign of x. the numerator is picked on the bits, a float select
+            // keeps the avx2 loop from vectorizing
+            if constexpr (math::vectorizable<T>) {
+                using int_t = typename math::ieee<T>::int_t;
+                int_t negative = std::bit_cast<int_t>(x) >> (sizeof(T)*8 - 1);
+                int_t numerator = (std::bit_cast<int_t>(e) & negative) | (std::bit_cast<int_t>(T{1}) & ~negative);
+                return std::bit_cast<T>(numerator)/(T{1} + e);
+            } else {
+                return (x < T{0} ? e : T{1})/(T{1} + e);
+            }
+        }
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void sigmoid_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T s = T{1}/(T{1} + math::exp<Accuracy>(-z));
+            return std::pair{s, s*(T{1} - s)};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void sigmoid_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) {
+            T s = T{1}/(T{1} + math::exp<Accuracy>(-z));
+            return s*(T{1} - s);
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void tanh_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T t = math::tanh<Accuracy>(z);
+            return std::pair{t, T{1} - t*t};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void tanh_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) {
+            T t = math::tanh<Accuracy>(z);
+            return T{1} - t*t;
+        });
+    }
+
+    template <std::floating_point T>
+    static void relu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            return z > T{0} ? std::pair{z, T{1}} : std::pair{T{0}, T{0}};
+        });
+    }
+
+    template <std::floating_point T>
+    static void relu_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::relu_grad(z); });
+    }
+
+    template <std::floating_point T>
+    static void prelu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad, T const& alpha) {
+        kernel::map(in, out, grad, [alpha](T z) {
+            return z > T{0} ? std::pair{z, T{1}} : std::pair{z*alpha, alpha};
+        });
+    }
+
+    template <std::floating_point T>
+    static void prelu_grad (std::span<T const> in, std::span<T> grad, T const& alpha) {
+        kernel::map(in, grad, [alpha](T z) { return activation::prelu_grad(z, alpha); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void elu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad, T const& alpha) {
+        kernel::map(in, out, grad, [alpha](T z) {
+            T e = math::expm1<Accuracy>(z);
+            return z > T{0} ? std::pair{z, T{1}} : std::pair{alpha*e, alpha*(e + T{1})};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void elu_grad (std::span<T const> in, std::span<T> grad, T const& alpha) {
+        kernel::map(in, grad, [alpha](T z) { return activation::elu_grad<T, Accuracy>(z, alpha); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void glu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T s = T{1}/(T{1} + math::exp<Accuracy>(-z));
+            return std::pair{z*s, s + z*s*(T{1} - s)};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void glu_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) {
+            T s = T{1}/(T{1} + math::exp<Accuracy>(-z));
+            return s + z*s*(T{1} - s);
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void swish_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        activation::glu_forward<T, Accuracy>(in, out, grad);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void swish_grad (std::span<T const> in, std::span<T> grad) {
+        activation::glu_grad<T, Accuracy>(in, grad);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void softplus_forward (std::span<T const> in, std::span<T> out, std::span<T> grad, T const& beta) {
+        kernel::map(in, out, grad, [beta](T z) {
+            // e = exp(-|x|) serves both and never overflows
+            T x = z*beta;
+            T e = math::exp<Accuracy>(-std::abs(math::softplus_cap(x)));
+            return std::pair{(std::max(x, T{0}) + math::log1p<Accuracy>(e))/beta, logistic(x, e)};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void softplus_grad (std::span<T const> in, std::span<T> grad, T const& beta) {
+        kernel::map(in, grad, [beta](T z) { return logistic(math::exp<Accuracy>(z*beta)); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void mish_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T c = math::softplus_cap(z);
+            T w = math::exp<Accuracy>(c);
+            T n = w*(w + T{2});
+            T r = T{1}/(n + T{2});
+            T t = n*r;
+            return std::pair{z*t, t + c*T{2}*r*(T{1} + t)*w/(T{1} + w)};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void mish_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::mish_grad<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T p = math::erfc<Accuracy>(-z*T(0.707106781186547524400844362104849039L))/T{2};
+            T phi = math::exp<Accuracy>(-z*z/T{2})*T(0.398942280401432677939946059934381868L);
+            return std::pair{z*p, p + z*phi};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::gelu_grad<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu_tanh_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T u = T(0.797884560802865355879892119868763737L)*(z + T(0.044715L)*z*z*z);
+            T du = T(0.797884560802865355879892119868763737L)*(T{1} + T(0.134145L)*z*z);
+            T s = T{1}/(T{1} + math::exp<Accuracy>(T{-2}*u));
+            return std::pair{z*s, s + T{2}*z*du*s*(T{1} - s)};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void gelu_tanh_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::gelu_tanh_grad<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void silu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        activation::glu_forward<T, Accuracy>(in, out, grad);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void silu_grad (std::span<T const> in, std::span<T> grad) {
+        activation::glu_grad<T, Accuracy>(in, grad);
+    }
+
+    template <std::floating_point T>
+    static void hard_sigmoid_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            return std::pair{activation::hard_sigmoid(z), activation::hard_sigmoid_grad(z)};
+        });
+    }
+
+    template <std::floating_point T>
+    static void hard_sigmoid_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::hard_sigmoid_grad(z); });
+    }
+
+    template <std::floating_point T>
+    static void hard_swish_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            return std::pair{activation::hard_swish(z), activation::hard_swish_grad(z)};
+        });
+    }
+
+    template <std::floating_point T>
+    static void hard_swish_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::hard_swish_grad(z); });
+    }
+
+    template <std::floating_point T>
+    static void leaky_relu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad, T const& alpha = T(0.01)) {
+        activation::prelu_forward<T>(in, out, grad, alpha);
+    }
+
+    template <std::floating_point T>
+    static void leaky_relu_grad (std::span<T const> in, std::span<T> grad, T const& alpha = T(0.01)) {
+        activation::prelu_grad<T>(in, grad, alpha);
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void selu_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            constexpr T lambda = T(selu_lambda), la = T(selu_lambda*selu_alpha);
+            T e = math::expm1<Accuracy>(z);
+            return z > T{0} ? std::pair{lambda*z, lambda} : std::pair{la*e, la*(e + T{1})};
+        });
+    }
+
+    template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+    static void selu_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::selu_grad<T, Accuracy>(z); });
+    }
+
+    template <std::floating_point T>
+    static void softsign_forward (std::span<T const> in, std::span<T> out, std::span<T> grad) {
+        kernel::map(in, out, grad, [](T z) {
+            T r = T{1}/(T{1} + std::abs(z));
+            return std::pair{z*r, r*r};
+        });
+    }
+
+    template <std::floating_point T>
+    static void softsign_grad (std::span<T const> in, std::span<T> grad) {
+        kernel::map(in, grad, [](T z) { return activation::softsign_grad(z); });
+    }
+
+    template <std::floating_point T>
+    static void backward (std::span<T const> grad, std::span<T const> grad_out, std::span<T> grad_in) {
+        // chain rule with the f'(z) saved by *_forward or *_grad,
+        // grad_in may be the same buffer as grad_out
+        assert(grad_out.size() >= grad.size() && grad_in.size() >= grad.size());
+        T const* d = grad.data();
+        T const* g = grad_out.data();
+        T* y = grad_in.data();
+        kernel::loop(grad.size(), [=](std::size_t i) { y[i] = g[i]*d[i]; });
+    }
+
+    namespace gated {
+        // gated linear units over the rows of [batch, 2d]. the first d values
+        // of a row are the linear half a, the last d the gate b, a row of the
+        // [batch, d] output is a*f(b), as torch.nn.functional.glu. a, b and
+        // the output stream through one loop, out may be the front of in.
+        // backward recomputes f(b) rather than reading a saved f'(b), which
+        // is fewer bytes than saving it in forward
+
+        template <std::floating_point T, typename F>
+        static void forward (std::span<T const> in, std::span<T> out, std::size_t d, F f) {
+            assert(d > 0 && in.size() % (2*d) == 0 && out.size() >= in.size()/2);
+            for (std::size_t row = 0; row < in.size()/(2*d); ++row) {
+                T const* a = in.data() + 2*d*row;
+                T const* b = a + d;
+                T* y = out.data() + d*row;
+                kernel::loop(d, [=](std::size_t i) { y[i] = a[i]*f(b[i]); });
+            }
+        }
+
+        template <std::floating_point T, typename F>
+        static void backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::size_t d, F f) {
+            // f returns the pair f(b), f'(b), then da = g*f(b), db = g*a*f'(b)
+            assert(d > 0 && in.size() % (2*d) == 0 && grad_out.size() >= in.size()/2 && grad_in.size() >= in.size());
+            for (std::size_t row = 0; row < in.size()/(2*d); ++row) {
+                T const* a = in.data() + 2*d*row;
+                T const* b = a + d;
+                T const* g = grad_out.data() + d*row;
+                T* da = grad_in.data() + 2*d*row;
+                T* db = da + d;
+                kernel::loop(d, [=](std::size_t i) {
+                    auto [v, dv] = f(b[i]);
+                    da[i] = g[i]*v;
+                    db[i] = g[i]*a[i]*dv;
+                });
+            }
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void glu (std::span<T const> in, std::span<T> out, std::size_t d) {
+            // a*sigmoid(b)
+            gated::forward(in, out, d, [](T z) { return T{1}/(T{1} + math::exp<Accuracy>(-z)); });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void glu_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::size_t d) {
+            gated::backward(in, grad_out, grad_in, d, [](T z) {
+                T s = T{1}/(T{1} + math::exp<Accuracy>(-z));
+                return std::pair{s, s*(T{1} - s)};
+            });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void swiglu (std::span<T const> in, std::span<T> out, std::size_t d) {
+            // a*swish(b), llama and palm
+            gated::forward(in, out, d, [](T z) { return z/(T{1} + math::exp<Accuracy>(-z)); });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void swiglu_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::size_t d) {
+            gated::backward(in, grad_out, grad_in, d, [](T z) {
+                T s = T{1}/(T{1} + math::exp<Accuracy>(-z));
+                return std::pair{z*s, s + z*s*(T{1} - s)};
+            });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void geglu (std::span<T const> in, std::span<T> out, std::size_t d) {
+            // a*gelu(b)
+            gated::forward(in, out, d, [](T z) { return activation::gelu<T, Accuracy>(z); });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void geglu_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::size_t d) {
+            gated::backward(in, grad_out, grad_in, d, [](T z) {
+                T p = math::erfc<Accuracy>(-z*T(0.707106781186547524400844362104849039L))/T{2};
+                T phi = math::exp<Accuracy>(-z*z/T{2})*T(0.398942280401432677939946059934381868L);
+                return std::pair{z*p, p + z*phi};
+            });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void geglu_tanh (std::span<T const> in, std::span<T> out, std::size_t d) {
+            // a*gelu_tanh(b), t5
+            gated::forward(in, out, d, [](T z) { return activation::gelu_tanh<T, Accuracy>(z); });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void geglu_tanh_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::size_t d) {
+            gated::backward(in, grad_out, grad_in, d, [](T z) {
+                T u = T(0.797884560802865355879892119868763737L)*(z + T(0.044715L)*z*z*z);
+                T du = T(0.797884560802865355879892119868763737L)*(T{1} + T(0.134145L)*z*z);
+                T s = T{1}/(T{1} + math::exp<Accuracy>(T{-2}*u));
+                return std::pair{z*s, s + T{2}*z*du*s*(T{1} - s)};
+            });
+        }
+
+        template <std::floating_point T>
+        static void reglu (std::span<T const> in, std::span<T> out, std::size_t d) {
+            // a*relu(b)
+            gated::forward(in, out, d, [](T z) { return activation::relu(z); });
+        }
+
+        template <std::floating_point T>
+        static void reglu_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::size_t d) {
+            gated::backward(in, grad_out, grad_in, d, [](T z) {
+                return z > T{0} ? std::pair{z, T{1}} : std::pair{T{0}, T{0}};
+            });
+        }
+    }
+
+    namespace channel {
+        // activations with one learned alpha per channel, as torch.nn.PReLU
+        // with num_parameters = channels, over [batch, channels, spatial]
+        // (nchw) or [batch, spatial, channels] (nhwc) tensors, spatial being
+        // h*w. alpha is never broadcast into a tensor: in nchw a channel is
+        // a contiguous run of spatial values under one alpha, in nhwc a pixel
+        // is a contiguous run of channels along the alpha vector, the inner
+        // loop is over that run either way. out may be the same buffer as in
+        enum class layout { nchw, nhwc };
+
+        template <std::floating_point T, typename F>
+        static void forward (std::span<T const> in, std::span<T> out, std::span<T const> alpha, std::size_t spatial, layout order, F f) {
+            // out = f(z, alpha of the channel of z)
+            std::size_t channels = alpha.size();
+            assert(channels > 0 && spatial > 0 && in.size() % (channels*spatial) == 0 && out.size() >= in.size());
+            if (order == layout::nchw) {
+                for (std::size_t run = 0; run < in.size()/spatial; ++run) {
+                    T const* x = in.data() + spatial*run;
+                    T* y = out.data() + spatial*run;
+                    T a = alpha[run % channels];
+                    kernel::loop(spatial, [=](std::size_t i) { y[i] = f(x[i], a); });
+                }
+            } else {
+                T const* a = alpha.data();
+                for (std::size_t pixel = 0; pixel < in.size()/channels; ++pixel) {
+                    T const* x = in.data() + channels*pixel;
+                    T* y = out.data() + channels*pixel;
+                    kernel::loop(channels, [=](std::size_t c) { y[c] = f(x[c], a[c]); });
+                }
+            }
+        }
+
+        template <std::floating_point T, typename F>
+        static void backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::span<T> grad_alpha,
+                              std::span<T const> alpha, std::size_t spatial, layout order, F f) {
+            // f returns the pair df/dz, df/dalpha. grad_in = g*df/dz and
+            // grad_alpha is overwritten with the sum of g*df/dalpha over the
+            // batch and the spatial positions of each channel. grad_in may
+            // be the same buffer as grad_out
+            std::size_t channels = alpha.size();
+            assert(channels > 0 && spatial > 0 && in.size() % (channels*spatial) == 0);
+            assert(grad_out.size() >= in.size() && grad_in.size() >= in.size() && grad_alpha.size() >= channels);
+            std::fill_n(grad_alpha.data(), channels, T{0});
+            if (order == layout::nchw) {
+                // the alpha terms of a run go through a small buffer on the
+                // stack, so f is evaluated once in a plain elementwise loop
+                // and the sum over the buffer vectorizes on its own
+                constexpr std::size_t chunk = 256;
+                T terms[chunk];
+                for (std::size_t run = 0; run < in.size()/spatial; ++run) {
+                    T a = alpha[run % channels];
+                    for (std::size_t first = spatial*run; first < spatial*(run + 1); first += chunk) {
+                        std::size_t n = std::min(chunk, spatial*(run + 1) - first);
+                        T const* x = in.data() + first;
+                        T const* g = grad_out.data() + first;
+                        T* dx = grad_in.data() + first;
+                        T* t = terms;
+                        kernel::loop(n, [=](std::size_t i) {
+                            auto [dz, da] = f(x[i], a);
+                            t[i] = g[i]*da;
+                            dx[i] = g[i]*dz;
+                        });
+                        grad_alpha[run % channels] += kernel::sum<T>(n, [=](std::size_t i) { return t[i]; });
+                    }
+                }
+            } else {
+                T const* a = alpha.data();
+                T* ga = grad_alpha.data();
+                for (std::size_t pixel = 0; pixel < in.size()/channels; ++pixel) {
+                    T const* x = in.data() + channels*pixel;
+                    T const* g = grad_out.data() + channels*pixel;
+                    T* dx = grad_in.data() + channels*pixel;
+                    kernel::loop(channels, [=](std::size_t c) {
+                        auto [dz, da] = f(x[c], a[c]);
+                        dx[c] = g[c]*dz;
+                        ga[c] += g[c]*da;
+                    });
+                }
+            }
+        }
+
+        template <std::floating_point T>
+        static void prelu (std::span<T const> in, std::span<T> out, std::span<T const> alpha, std::size_t spatial, layout order) {
+            channel::forward(in, out, alpha, spatial, order, [](T z, T a) { return activation::prelu(z, a); });
+        }
+
+        template <std::floating_point T>
+        static void prelu_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::span<T> grad_alpha,
+                                    std::span<T const> alpha, std::size_t spatial, layout order) {
+            // dprelu/dalpha is min(z, 0)
+            channel::backward(in, grad_out, grad_in, grad_alpha, alpha, spatial, order, [](T z, T a) {
+                return std::pair{math::select_positive(z, T{1}, a), math::select_positive(z, T{0}, z)};
+            });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void elu (std::span<T const> in, std::span<T> out, std::span<T const> alpha, std::size_t spatial, layout order) {
+            channel::forward(in, out, alpha, spatial, order, [](T z, T a) { return activation::elu<T, Accuracy>(z, a); });
+        }
+
+        template <std::floating_point T, accuracy::policy Accuracy = accuracy::ulp1>
+        static void elu_backward (std::span<T const> in, std::span<T const> grad_out, std::span<T> grad_in, std::span<T> grad_alpha,
+                                  std::span<T const> alpha, std::size_t spatial, layout order) {
+            // delu/dalpha is expm1(z) for z <= 0
+            channel::backward(in, grad_out, grad_in, grad_alpha, alpha, spatial, order, [](T z, T a) {
+                T e = math::expm1<Accuracy>(z);
+                return std::pair{math::select_positive(z, T{1}, a*(e + T{1})), math::select_positive(z, T{0}, e)};
+            });
+        }
+    }
+}
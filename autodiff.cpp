@@ -0,0 +1,87 @@
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+#include "autodiff.hpp"
+#include "activation.hpp"
+#include "loss.hpp"
+
+int main () {
+    // value and derivative of an activation in one evaluation
+    auto mish = autodiff::derivative([](auto z) { return activation::mish(z); }, 2.0);
+    std::cout << "mish(2) = " << mish.value << ", mish'(2) = " << mish.derivative() << std::endl;
+    std::cout << "mish_grad(2) = " << activation::mish_grad(2.0) << std::endl;
+
+    auto elu = autodiff::derivative([](auto z) { return activation::elu(z, 0.1); }, -0.5);
+    std::cout << "elu(-0.5) = " << elu.value << ", elu'(-0.5) = " << elu.derivative() << std::endl;
+
+    // second derivative, a dual over the derivative of sigmoid
+    auto sigmoid2 = autodiff::derivative([](auto z) { return activation::sigmoid_grad(z); }, 0.5);
+    std::cout << "sigmoid''(0.5) = " << sigmoid2.derivative() << std::endl;
+
+    auto print_range = []<typename Range>(Range const& r) -> void {
+        std::cout << "{ ";
+        for (auto v : r) {
+            std::cout << v << " ";
+        }
+        std::cout << "}" << std::endl;
+    };
+
+    // gradient of a loss w.r.t. predicted, four directions per evaluation
+    std::vector<double> ground = {0.1, 0.5, 0.9, 0.3, 0.7};
+    std::vector<double> predicted = {0.2, 0.4, 0.6, 0.5, 0.9};
+    std::vector<double> grad(predicted.size());
+
+    using number = autodiff::dual<double, 4>;
+    auto gnd = autodiff::constant<4, double>(ground);
+    double huber = autodiff::gradient<4, double>([&](auto const& pred) {
+        return loss::huber_f(gnd, pred, number{0.15});
+    }, predicted, grad);
+    std::cout << "huber = " << huber << ", d/dpred = "; print_range(grad);
+
+    loss::huber_grad(ground, predicted, grad, 0.15);
+    std::cout << "huber_grad = "; print_range(grad);
+
+    double bce = autodiff::gradient<4, double>([&](auto const& pred) {
+        return loss::bce_f(gnd, pred);
+    }, predicted, grad);
+    std::cout << "bce = " << bce << ", d/dpred = "; print_range(grad);
+
+    // reverse mode, a 2-8-2 mlp learns xor with full batch gradient descent
+    std::vector<double> x = {0, 0, 0, 1, 1, 0, 1, 1};
+    std::vector<double> labels = {1, 0, 0, 1, 0, 1, 1, 0};
+    std::vector<double> w1(2*8), b1(8, 0.0), w2(8*2), b2(2, 0.0);
+    for (std::size_t i = 0; i < w1.size(); ++i) w1[i] = 0.5*std::sin(1.0 + 3.0*i);
+    for (std::size_t i = 0; i < w2.size(); ++i) w2[i] = 0.5*std::cos(2.0 + 5.0*i);
+    std::vector<double> dw1(w1.size()), db1(b1.size()), dw2(w2.size()), db2(b2.size());
+
+    autodiff::tape<double> t;
+    for (int step = 0; step <= 2000; ++step) {
+        t.clear();
+        for (auto* g : {&dw1, &db1, &dw2, &db2}) std::fill(g->begin(), g->end(), 0.0);
+
+        auto in = t.input(x);
+        auto hidden = t.tanh(t.add(t.matmul(in, t.parameter(w1, dw1), 8), t.parameter(b1, db1)));
+        auto logits = t.add(t.matmul(hidden, t.parameter(w2, dw2), 2), t.parameter(b2, db2));
+        auto ce = t.ce_from_logits(labels, logits, 2);
+        t.backward(ce);
+
+        if (step % 500 == 0) {
+            std::cout << "step " << step << ", ce = " << t.value(ce)[0] << std::endl;
+        }
+        for (auto [p, g] : {std::pair{&w1, &dw1}, {&b1, &db1}, {&w2, &dw2}, {&b2, &db2}}) {
+            for (std::size_t i = 0; i < p->size(); ++i) (*p)[i] -= 0.5*(*g)[i];
+        }
+    }
+
+    t.clear();
+    auto hidden = t.tanh(t.add(t.matmul(t.input(x), t.input(w1), 8), t.input(b1)));
+    auto logits = t.add(t.matmul(hidden, t.input(w2), 2), t.input(b2));
+    std::vector<double> probabilities(labels.size());
+    loss::softmax<double>(t.value(logits), probabilities, 2);
+    std::cout << "p(xor = 0), p(xor = 1) = "; print_range(probabilities);
+
+    return 0;
+}
@@ -0,0 +1,617 @@
+#pragma once
+
+#include <concepts>
+#include <compare>
+#include <cmath>
+
+#include <array>
+#include <span>
+#include <vector>
+#include <cassert>
+#include <utility>
+#include <algorithm>
+
+#include "activation.hpp"
+#include "loss.hpp"
+
+namespace autodiff {
+    // forward mode. a dual carries a value and its derivatives along N
+    // directions, every operation applies the chain rule to all of them, so
+    // one evaluation of f on duals gives f and N directional derivatives.
+    // it satisfies activation::number, the scalar activations and the
+    // per-element loss terms take it as they take a float.
+
+    template <std::floating_point T, std::size_t N = 1>
+    struct dual {
+        // the tangents are contiguous and every operation is a loop over
+        // them, which vectorizes once N is a multiple of the simd width
+        using value_type = T;
+        static constexpr std::size_t directions = N;
+
+        T value{};
+        std::array<T, N> tangent{};
+
+        constexpr dual () = default;
+
+        constexpr dual (T const& value) : value(value) {}
+
+        constexpr dual (T const& value, std::array<T, N> const& tangent) : value(value), tangent(tangent) {}
+
+        static constexpr dual variable (T const& value, std::size_t direction = 0) {
+            // the input that direction differentiates against
+            dual x{value};
+            x.tangent[direction] = T{1};
+            return x;
+        }
+
+        constexpr T derivative (std::size_t direction = 0) const {
+            return tangent[direction];
+        }
+
+        constexpr dual& operator+= (dual const& b) {
+            value += b.value;
+            for (std::size_t k = 0; k < N; ++k) tangent[k] += b.tangent[k];
+            return *this;
+        }
+
+        constexpr dual& operator-= (dual const& b) {
+            value -= b.value;
+            for (std::size_t k = 0; k < N; ++k) tangent[k] -= b.tangent[k];
+            return *this;
+        }
+
+        constexpr dual& operator*= (dual const& b) {
+            for (std::size_t k = 0; k < N; ++k) tangent[k] = tangent[k]*b.value + value*b.tangent[k];
+            value *= b.value;
+            return *this;
+        }
+
+        constexpr dual& operator/= (dual const& b) {
+            T inv = T{1}/b.value;
+            value *= inv;
+            for (std::size_t k = 0; k < N; ++k) tangent[k] = (tangent[k] - value*b.tangent[k])*inv;
+            return *this;
+        }
+
+        constexpr dual& operator+= (T const& b) {
+            value += b;
+            return *this;
+        }
+
+        constexpr dual& operator-= (T const& b) {
+            value -= b;
+            return *this;
+        }
+
+        constexpr dual& operator*= (T const& b) {
+            value *= b;
+            for (std::size_t k = 0; k < N; ++k) tangent[k] *= b;
+            return *this;
+        }
+
+        constexpr dual& operator/= (T const& b) {
+            return *this *= T{1}/b;
+        }
+
+        // hidden friends, so mixed operations with plain numbers convert
+        // them and the math functions are found by adl only
+        friend constexpr dual operator- (dual a) {
+            a.value = -a.value;
+            for (std::size_t k = 0; k < N; ++k) a.tangent[k] = -a.tangent[k];
+            return a;
+        }
+
+        friend constexpr dual operator+ (dual a, dual const& b) { return a += b; }
+        friend constexpr dual operator- (dual a, dual const& b) { return a -= b; }
+        friend constexpr dual operator* (dual a, dual const& b) { return a *= b; }
+        friend constexpr dual operator/ (dual a, dual const& b) { return a /= b; }
+
+        // a plain number has no tangents, skip the work on them
+        friend constexpr dual operator+ (dual a, T const& b) { return a += b; }
+        friend constexpr dual operator- (dual a, T const& b) { return a -= b; }
+        friend constexpr dual operator* (dual a, T const& b) { return a *= b; }
+        friend constexpr dual operator/ (dual a, T const& b) { return a /= b; }
+        friend constexpr dual operator+ (T const& a, dual b) { return b += a; }
+        friend constexpr dual operator- (T const& a, dual const& b) { return -b + a; }
+        friend constexpr dual operator* (T const& a, dual b) { return b *= a; }
+        friend constexpr dual operator/ (T const& a, dual const& b) { return dual{a}/b; }
+
+        // ordering is on the value, branches then pick a side like on floats
+        friend constexpr bool operator== (dual const& a, dual const& b) { return a.value == b.value; }
+        friend constexpr auto operator<=> (dual const& a, dual const& b) { return a.value <=> b.value; }
+
+        friend constexpr dual exp (dual const& x) {
+            T e = std::exp(x.value);
+            return chain(x, e, e);
+        }
+
+        friend constexpr dual expm1 (dual const& x) {
+            T e = std::expm1(x.value);
+            return chain(x, e, e + T{1});
+        }
+
+        friend constexpr dual log (dual const& x) {
+            return chain(x, std::log(x.value), T{1}/x.value);
+        }
+
+        friend constexpr dual log1p (dual const& x) {
+            return chain(x, std::log1p(x.value), T{1}/(T{1} + x.value));
+        }
+
+        friend constexpr dual tanh (dual const& x) {
+            T t = std::tanh(x.value);
+            return chain(x, t, T{1} - t*t);
+        }
+
+        friend constexpr dual erfc (dual const& x) {
+            constexpr T two_over_sqrt_pi = T(1.12837916709551257389615890312154517L);
+            return chain(x, std::erfc(x.value), -two_over_sqrt_pi*std::exp(-x.value*x.value));
+        }
+
+        friend constexpr dual sqrt (dual const& x) {
+            T s = std::sqrt(x.value);
+            return chain(x, s, T{0.5}/s);
+        }
+
+        friend constexpr dual abs (dual const& x) {
+            // the subgradient 0 at 0, as L1_grad
+            return chain(x, std::abs(x.value), T(x.value > T{0}) - T(x.value < T{0}));
+        }
+
+        friend constexpr dual pow (dual const& x, T const& p) {
+            T y = std::pow(x.value, p - T{1});
+            return chain(x, y*x.value, p*y);
+        }
+
+    private:
+        static constexpr dual chain (dual const& x, T const& fx, T const& dfx) {
+            // f(x) with the tangents of x scaled by f'(x)
+            dual y{fx};
+            for (std::size_t k = 0; k < N; ++k) y.tangent[k] = dfx*x.tangent[k];
+            return y;
+        }
+    };
+
+    template <typename F, std::floating_point T>
+    static constexpr dual<T> derivative (F f, T const& x) {
+        // f(x) and f'(x) in one evaluation, e.g.
+        //   autodiff::derivative([](auto z) { return activation::mish(z); }, 2.0)
+        return f(dual<T>::variable(x));
+    }
+
+    template <std::size_t N = 1, std::floating_point T>
+    static std::vector<dual<T, N>> constant (std::span<T const> x) {
+        // inputs that are not differentiated against, e.g. the ground truth
+        // of a loss, which must be a range of the same duals as predicted
+        return std::vector<dual<T, N>>(x.begin(), x.end());
+    }
+
+    template <std::size_t N = 8, std::floating_point T, typename F>
+    static T gradient (F f, std::span<T const> x, std::span<T> grad) {
+        // gradient of the scalar f over x. f takes a std::vector of duals and
+        // returns a dual, every evaluation seeds the next N elements of x, so
+        // the gradient costs n/N evaluations of f, against 2n for central
+        // differences. returns f(x)
+        assert(grad.size() >= x.size());
+        auto xs = autodiff::constant<N>(x);
+        if (x.empty()) {
+            return f(std::as_const(xs)).value;
+        }
+
+        T value{};
+        for (std::size_t first = 0; first < x.size(); first += N) {
+            std::size_t count = std::min(N, x.size() - first);
+            for (std::size_t k = 0; k < count; ++k) xs[first + k].tangent[k] = T{1};
+
+            dual<T, N> y = f(std::as_const(xs));
+            value = y.value;
+
+            for (std::size_t k = 0; k < count; ++k) {
+                grad[first + k] = y.tangent[k];
+                xs[first + k].tangent[k] = T{0};
+            }
+        }
+        return value;
+    }
+
+    // reverse mode. a tape records whole-tensor operations as they run and
+    // backward walks them in reverse, so a step costs one kernel per node
+    // each way. the primitives are the activations and losses of this repo
+    // plus the add, mul and matmul needed to build layers from them. values,
+    // gradients, the saved f'(z) of the activations and the packed w^T of a
+    // matmul come from one arena, clear() keeps its memory, so after the
+    // first step nothing allocates.
+
+    template <std::floating_point T, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    class tape {
+    public:
+        struct var {
+            std::size_t id;
+        };
+
+        explicit tape (std::size_t capacity = 0, std::size_t nodes = 0) {
+            arena.resize(capacity);
+            graph.reserve(nodes);
+        }
+
+        void clear () {
+            // forget the recorded nodes, keep the memory for the next step
+            graph.clear();
+            used = 0;
+        }
+
+        // views into the arena, valid until the next recorded op, which may
+        // grow it, or clear(), after which the next step overwrites it
+        std::span<T const> value (var v) const {
+            node const& n = graph[v.id];
+            return {arena.data() + n.value, n.size};
+        }
+
+        std::span<T const> grad (var v) const {
+            node const& n = graph[v.id];
+            return {arena.data() + n.grad, n.size};
+        }
+
+        // leaves. inputs are constants, the gradient of a parameter is added
+        // to the caller's grad buffer by backward, which must outlive it
+        var input (std::span<T const> x) {
+            return leaf(x, {});
+        }
+
+        var parameter (std::span<T const> x, std::span<T> grad) {
+            assert(grad.size() >= x.size());
+            return leaf(x, grad);
+        }
+
+        var add (var a, var b) {
+            // a + b, b is broadcast over the rows of a when it is shorter,
+            // e.g. a bias over [batch, out]
+            std::size_t n = graph[a.id].size, m = graph[b.id].size;
+            assert(m > 0 && n % m == 0);
+            var y = record(op::add, n, a, b);
+            T* out = data(y, &node::value);
+            T const* x = data(a, &node::value);
+            T const* z = data(b, &node::value);
+            for (std::size_t row = 0; row < n; row += m) {
+                activation::kernel::loop(m, [=](std::size_t i) { out[row + i] = x[row + i] + z[i]; });
+            }
+            return y;
+        }
+
+        var mul (var a, var b) {
+            // elementwise a*b
+            std::size_t n = graph[a.id].size;
+            assert(graph[b.id].size == n);
+            var y = record(op::mul, n, a, b);
+            T* out = data(y, &node::value);
+            T const* x = data(a, &node::value);
+            T const* z = data(b, &node::value);
+            activation::kernel::loop(n, [=](std::size_t i) { out[i] = x[i]*z[i]; });
+            return y;
+        }
+
+        var matmul (var a, var b, std::size_t cols) {
+            // row-major [rows, inner] times [inner, cols]
+            std::size_t inner = graph[b.id].size/cols;
+            std::size_t rows = graph[a.id].size/inner;
+            assert(cols > 0 && graph[b.id].size == inner*cols && graph[a.id].size == rows*inner);
+            var y = record(op::matmul, rows*cols, a, b, cols);
+            if (graph[a.id].requires_grad) {
+                // saved holds w^T for dx, packed while w is still in cache
+                graph[y.id].saved = allocate(inner*cols);
+            }
+            T* out = data(y, &node::value);
+            T const* x = data(a, &node::value);
+            T const* w = data(b, &node::value);
+            std::fill_n(out, rows*cols, T{0});
+            for (std::size_t r = 0; r < rows; ++r) {
+                T* o = out + r*cols;
+                for (std::size_t k = 0; k < inner; ++k) {
+                    T xk = x[r*inner + k];
+                    T const* wk = w + k*cols;
+                    activation::kernel::loop(cols, [=](std::size_t c) { o[c] += xk*wk[c]; });
+                }
+            }
+            if (graph[a.id].requires_grad) {
+                T* wt = data(y, &node::saved);
+                for (std::size_t k = 0; k < inner; ++k) {
+                    for (std::size_t c = 0; c < cols; ++c) wt[c*inner + k] = w[k*cols + c];
+                }
+            }
+            return y;
+        }
+
+        // activations, the forward kernels save f'(z) for backward
+        var sigmoid (var z) { return unary(z, [](auto in, auto out, auto d) { activation::sigmoid_forward<T, Accuracy>(in, out, d); }); }
+        var tanh (var z) { return unary(z, [](auto in, auto out, auto d) { activation::tanh_forward<T, Accuracy>(in, out, d); }); }
+        var relu (var z) { return unary(z, [](auto in, auto out, auto d) { activation::relu_forward<T>(in, out, d); }); }
+        var glu (var z) { return unary(z, [](auto in, auto out, auto d) { activation::glu_forward<T, Accuracy>(in, out, d); }); }
+        var swish (var z) { return unary(z, [](auto in, auto out, auto d) { activation::swish_forward<T, Accuracy>(in, out, d); }); }
+        var mish (var z) { return unary(z, [](auto in, auto out, auto d) { activation::mish_forward<T, Accuracy>(in, out, d); }); }
+        var gelu (var z) { return unary(z, [](auto in, auto out, auto d) { activation::gelu_forward<T, Accuracy>(in, out, d); }); }
+        var gelu_tanh (var z) { return unary(z, [](auto in, auto out, auto d) { activation::gelu_tanh_forward<T, Accuracy>(in, out, d); }); }
+        var silu (var z) { return unary(z, [](auto in, auto out, auto d) { activation::silu_forward<T, Accuracy>(in, out, d); }); }
+        var hard_sigmoid (var z) { return unary(z, [](auto in, auto out, auto d) { activation::hard_sigmoid_forward<T>(in, out, d); }); }
+        var hard_swish (var z) { return unary(z, [](auto in, auto out, auto d) { activation::hard_swish_forward<T>(in, out, d); }); }
+        var selu (var z) { return unary(z, [](auto in, auto out, auto d) { activation::selu_forward<T, Accuracy>(in, out, d); }); }
+        var softsign (var z) { return unary(z, [](auto in, auto out, auto d) { activation::softsign_forward<T>(in, out, d); }); }
+
+        var prelu (var z, T alpha) {
+            return unary(z, [alpha](auto in, auto out, auto d) { activation::prelu_forward<T>(in, out, d, alpha); });
+        }
+
+        var leaky_relu (var z, T alpha = T(0.01)) {
+            return prelu(z, alpha);
+        }
+
+        var elu (var z, T alpha) {
+            return unary(z, [alpha](auto in, auto out, auto d) { activation::elu_forward<T, Accuracy>(in, out, d, alpha); });
+        }
+
+        var softplus (var z, T beta) {
+            return unary(z, [beta](auto in, auto out, auto d) { activation::softplus_forward<T, Accuracy>(in, out, d, beta); });
+        }
+
+        // gated linear units of [batch, 2d] to [batch, d], see activation::gated.
+        // the one argument glu above is swish, this one splits value and gate
+        var glu (var z, std::size_t d) {
+            return gate(z, d, [](auto in, auto out, std::size_t d) { activation::gated::glu<T, Accuracy>(in, out, d); },
+                        activation::gated::glu_backward<T, Accuracy>);
+        }
+
+        var swiglu (var z, std::size_t d) {
+            return gate(z, d, [](auto in, auto out, std::size_t d) { activation::gated::swiglu<T, Accuracy>(in, out, d); },
+                        activation::gated::swiglu_backward<T, Accuracy>);
+        }
+
+        var geglu (var z, std::size_t d) {
+            return gate(z, d, [](auto in, auto out, std::size_t d) { activation::gated::geglu<T, Accuracy>(in, out, d); },
+                        activation::gated::geglu_backward<T, Accuracy>);
+        }
+
+        var geglu_tanh (var z, std::size_t d) {
+            return gate(z, d, [](auto in, auto out, std::size_t d) { activation::gated::geglu_tanh<T, Accuracy>(in, out, d); },
+                        activation::gated::geglu_tanh_backward<T, Accuracy>);
+        }
+
+        var reglu (var z, std::size_t d) {
+            return gate(z, d, [](auto in, auto out, std::size_t d) { activation::gated::reglu<T>(in, out, d); },
+                        activation::gated::reglu_backward<T>);
+        }
+
+        // losses of predicted against constant ground truth, scalar nodes.
+        // the value_and_grad functions save dloss/dpredicted for backward
+        using span = std::span<T const>;
+
+        var L1 (span ground, var predicted) { return scalar(predicted, [=](span p, std::span<T> d) { return loss::L1_value_and_grad(ground, p, d); }); }
+        var L2 (span ground, var predicted) { return scalar(predicted, [=](span p, std::span<T> d) { return loss::L2_value_and_grad(ground, p, d); }); }
+        var bce (span ground, var predicted) { return scalar(predicted, [=](span p, std::span<T> d) { return loss::bce_value_and_grad(ground, p, d); }); }
+        var ce (span ground, var predicted) { return scalar(predicted, [=](span p, std::span<T> d) { return loss::ce_value_and_grad(ground, p, d); }); }
+        var kl (span ground, var predicted) { return scalar(predicted, [=](span p, std::span<T> d) { return loss::kl_value_and_grad(ground, p, d); }); }
+        var hinge (span ground, var predicted) { return scalar(predicted, [=](span p, std::span<T> d) { return loss::hinge_value_and_grad(ground, p, d); }); }
+
+        var huber (span ground, var predicted, T threshold) {
+            return scalar(predicted, [=](span p, std::span<T> d) { return loss::huber_value_and_grad(ground, p, d, threshold); });
+        }
+
+        var bce_with_logits (span ground, var logits) {
+            return scalar(logits, [=](span z, std::span<T> d) { return loss::bce_with_logits_value_and_grad<T>(ground, z, d); });
+        }
+
+        var ce_from_logits (span ground, var logits, std::size_t classes) {
+            // mean over the rows of [batch, classes], per row
+            // d/dz = (sum(g)*softmax(z) - g)/(classes*batch)
+            return scalar(logits, [=](span z, std::span<T> d) {
+                T value = loss::ce_from_logits<T>(ground, z, classes);
+                loss::softmax<T>(z, d, classes);
+                T scale = T{1}/z.size();
+                for (std::size_t row = 0; row < z.size(); row += classes) {
+                    T mass = 0;
+                    for (std::size_t i = row; i < row + classes; ++i) mass += ground[i];
+                    for (std::size_t i = row; i < row + classes; ++i) d[i] = (mass*d[i] - ground[i])*scale;
+                }
+                return value;
+            });
+        }
+
+        void backward (var root) {
+            // seeds droot = 1 and runs the chain rule down to the parameters.
+            // gradients accumulate, record a fresh pass before the next call
+            std::fill_n(data(root, &node::grad), graph[root.id].size, T{1});
+            for (std::size_t id = root.id + 1; id-- > 0;) {
+                node const& n = graph[id];
+                if (!n.requires_grad) {
+                    continue;
+                }
+                T const* g = arena.data() + n.grad;
+                switch (n.kind) {
+                    case op::leaf: {
+                        T* p = n.external_grad;
+                        activation::kernel::loop(n.size, [=](std::size_t i) { p[i] += g[i]; });
+                        break;
+                    }
+                    case op::add: {
+                        std::size_t m = graph[n.b].size;
+                        accumulate(n.a, n.size, [=](std::size_t i) { return g[i]; });
+                        if (graph[n.b].requires_grad) {
+                            T* gb = arena.data() + graph[n.b].grad;
+                            for (std::size_t row = 0; row < n.size; row += m) {
+                                activation::kernel::loop(m, [=](std::size_t i) { gb[i] += g[row + i]; });
+                            }
+                        }
+                        break;
+                    }
+                    case op::mul: {
+                        T const* x = arena.data() + graph[n.a].value;
+                        T const* z = arena.data() + graph[n.b].value;
+                        accumulate(n.a, n.size, [=](std::size_t i) { return g[i]*z[i]; });
+                        accumulate(n.b, n.size, [=](std::size_t i) { return g[i]*x[i]; });
+                        break;
+                    }
+                    case op::matmul:
+                        matmul_backward(n);
+                        break;
+                    case op::unary: {
+                        T const* d = arena.data() + n.saved;
+                        accumulate(n.a, n.size, [=](std::size_t i) { return g[i]*d[i]; });
+                        break;
+                    }
+                    case op::gated: {
+                        // the kernel writes the input gradient to saved, which
+                        // is then added like the others
+                        node const& a = graph[n.a];
+                        T* d = arena.data() + n.saved;
+                        n.gated_backward(std::span<T const>(arena.data() + a.value, a.size), std::span<T const>(g, n.size),
+                                         std::span<T>(d, a.size), n.cols);
+                        accumulate(n.a, a.size, [=](std::size_t i) { return d[i]; });
+                        break;
+                    }
+                    case op::scalar: {
+                        T const* d = arena.data() + n.saved;
+                        T g0 = g[0];
+                        accumulate(n.a, graph[n.a].size, [=](std::size_t i) { return g0*d[i]; });
+                        break;
+                    }
+                }
+            }
+        }
+
+    private:
+        enum class op { leaf, add, mul, matmul, unary, gated, scalar };
+
+        using gated_kernel = void (*) (std::span<T const>, std::span<T const>, std::span<T>, std::size_t);
+
+        struct node {
+            op kind;
+            std::size_t size;
+            std::size_t a = 0, b = 0;   // input nodes
+            std::size_t cols = 0;       // of matmul, d of gated
+            std::size_t value = 0, grad = 0, saved = 0;   // arena offsets
+            T* external_grad = nullptr;
+            gated_kernel gated_backward = nullptr;
+            bool requires_grad = false;
+        };
+
+        std::vector<T> arena;
+        std::size_t used = 0;
+        std::vector<node> graph;
+
+        std::size_t allocate (std::size_t n) {
+            // bump allocation, the arena only grows while the first steps
+            // find out how much a step needs
+            std::size_t offset = used;
+            used += n;
+            if (arena.size() < used) {
+                arena.resize(std::max(used, 2*arena.size()));
+            }
+            return offset;
+        }
+
+        T* data (var v, std::size_t node::* field) {
+            return arena.data() + graph[v.id].*field;
+        }
+
+        var record (op kind, std::size_t size, var a, var b, std::size_t cols = 0, bool saved = false) {
+            node n{kind, size, a.id, b.id, cols};
+            n.requires_grad = graph[a.id].requires_grad || graph[b.id].requires_grad;
+            n.value = allocate(size);
+            n.grad = allocate(size);
+            std::fill_n(arena.data() + n.grad, size, T{0});
+            if (saved) {
+                n.saved = allocate(size);
+            }
+            graph.push_back(n);
+            return {graph.size() - 1};
+        }
+
+        var leaf (std::span<T const> x, std::span<T> grad) {
+            node n{op::leaf, x.size()};
+            n.external_grad = grad.data();
+            n.requires_grad = !grad.empty();
+            n.value = allocate(x.size());
+            n.grad = allocate(x.size());
+            std::copy(x.begin(), x.end(), arena.data() + n.value);
+            std::fill_n(arena.data() + n.grad, x.size(), T{0});
+            graph.push_back(n);
+            return {graph.size() - 1};
+        }
+
+        template <typename F>
+        var unary (var z, F forward) {
+            std::size_t n = graph[z.id].size;
+            var y = record(op::unary, n, z, z, 0, true);
+            node const& y_node = graph[y.id];
+            forward(std::span<T const>(arena.data() + graph[z.id].value, n),
+                    std::span<T>(arena.data() + y_node.value, n),
+                    std::span<T>(arena.data() + y_node.saved, n));
+            return y;
+        }
+
+        template <typename F>
+        var gate (var z, std::size_t d, F forward, gated_kernel backward) {
+            // y is [batch, d], saved holds the [batch, 2d] gradient in backward
+            std::size_t n = graph[z.id].size;
+            assert(d > 0 && n % (2*d) == 0);
+            var y = record(op::gated, n/2, z, z, d);
+            graph[y.id].saved = allocate(n);
+            graph[y.id].gated_backward = backward;
+            node const& y_node = graph[y.id];
+            forward(std::span<T const>(arena.data() + graph[z.id].value, n), std::span<T>(arena.data() + y_node.value, n/2), d);
+            return y;
+        }
+
+        template <typename F>
+        var scalar (var predicted, F value_and_grad) {
+            // the node holds the loss, saved holds its gradient w.r.t. predicted
+            std::size_t n = graph[predicted.id].size;
+            var y = record(op::scalar, 1, predicted, predicted);
+            graph[y.id].saved = allocate(n);
+            node const& y_node = graph[y.id];
+            arena[y_node.value] = value_and_grad(std::span<T const>(arena.data() + graph[predicted.id].value, n),
+                                                 std::span<T>(arena.data() + y_node.saved, n));
+            return y;
+        }
+
+        template <typename F>
+        void accumulate (std::size_t id, std::size_t n, F f) {
+            // grad[id] += f(i), skipped for inputs
+            if (graph[id].requires_grad) {
+                T* g = arena.data() + graph[id].grad;
+                activation::kernel::loop(n, [=](std::size_t i) { g[i] += f(i); });
+            }
+        }
+
+        void matmul_backward (node const& n) {
+            // dx = g*w^T over the packed w^T with inner innermost, dw = x^T*g
+            // with cols innermost
+            node const& a = graph[n.a];
+            node const& b = graph[n.b];
+            std::size_t cols = n.cols, inner = b.size/cols, rows = a.size/inner;
+            T const* g = arena.data() + n.grad;
+            T const* x = arena.data() + a.value;
+            if (a.requires_grad) {
+                T* gx = arena.data() + a.grad;
+                T const* wt = arena.data() + n.saved;
+                for (std::size_t r = 0; r < rows; ++r) {
+                    T* gr = gx + r*inner;
+                    for (std::size_t c = 0; c < cols; ++c) {
+                        T gc = g[r*cols + c];
+                        T const* wc = wt + c*inner;
+                        activation::kernel::loop(inner, [=](std::size_t k) { gr[k] += gc*wc[k]; });
+                    }
+                }
+            }
+            if (b.requires_grad) {
+                T* gw = arena.data() + b.grad;
+                for (std::size_t r = 0; r < rows; ++r) {
+                    T const* gr = g + r*cols;
+                    for (std::size_t k = 0; k < inner; ++k) {
+                        T xk = x[r*inner + k];
+                        T* gk = gw + k*cols;
+                        activation::kernel::loop(cols, [=](std::size_t c) { gk[c] += xk*gr[c]; });
+                    }
+                }
+            }
+        }
+    };
+}
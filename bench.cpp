@@ -0,0 +1,393 @@
+// benchmarks for every loss and activation kernel, float and double,
+// from 16 elements up to 128 MiB per buffer, the f16/bf16 paths and the
+// int8/uint8 table lookups. time per element and bytes per second are
+// reported as counters next to the usual timings.
+//
+//   g++ -std=c++23 -O3 -march=native bench.cpp -o bench -lbenchmark -lpthread
+//   ./bench --benchmark_filter=loss/L1
+//
+// the inputs are generated once per element type at the largest size and
+// every benchmark runs on a prefix of them
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "activation.hpp"
+#include "loss.hpp"
+#include "layer.hpp"
+#include "half.hpp"
+#include "quantized.hpp"
+
+namespace {
+
+    constexpr std::size_t min_size = 16;
+    constexpr std::size_t max_bytes = std::size_t{128} << 20;
+
+    // the largest n registered for T, max_bytes per input buffer. the 16-bit
+    // types and the bytes stop where float does, they're made from its inputs
+    template <typename T>
+    constexpr std::size_t max_size = max_bytes/std::max(sizeof(T), sizeof(float));
+
+    template <typename T>
+    struct inputs {
+        // ground and predicted are probabilities away from 0 and 1 so that
+        // bce, ce and kl stay finite, z is symmetric around 0 for the activations
+        std::vector<T> ground, predicted, z, out;
+
+        static inputs& get () {
+            static inputs data;
+            return data;
+        }
+
+    private:
+        inputs () : ground(max_size<T>), predicted(max_size<T>), z(max_size<T>), out(max_size<T>) {
+            if constexpr (half::storage<T>) {
+                // the float inputs rounded to 16 bits
+                auto const& data = inputs<float>::get();
+                half::narrow<T>(data.ground, ground);
+                half::narrow<T>(data.predicted, predicted);
+                half::narrow<T>(data.z, z);
+            } else {
+                std::mt19937_64 gen(42);
+                std::uniform_real_distribution<T> probability(T(0.05), T(0.95)), logit(T(-8), T(8));
+                for (std::size_t i = 0; i < max_size<T>; ++i) {
+                    ground[i] = probability(gen);
+                    predicted[i] = probability(gen);
+                    z[i] = logit(gen);
+                }
+            }
+        }
+    };
+
+    template <typename T>
+    constexpr char const* type_name = std::is_same_v<T, float> ? "float"
+                                    : std::is_same_v<T, double> ? "double"
+                                    : std::is_same_v<T, half::float16> ? "f16" : "bf16";
+
+    void set_counters (benchmark::State& state, std::size_t n, std::size_t bytes_per_element) {
+        state.SetItemsProcessed(state.iterations()*n);
+        state.SetBytesProcessed(state.iterations()*n*bytes_per_element);
+        state.counters["s/element"] = benchmark::Counter(double(n),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+    }
+
+    template <typename T, typename F>
+    void add_loss (std::string const& name, F f) {
+        // f(ground, predicted) over two spans of n elements
+        benchmark::RegisterBenchmark(("loss/" + name + "/" + type_name<T>).c_str(), [f](benchmark::State& state) {
+            auto& data = inputs<T>::get();
+            std::size_t n = state.range(0);
+            std::span<T const> ground(data.ground.data(), n), predicted(data.predicted.data(), n);
+            for (auto _ : state) {
+                benchmark::DoNotOptimize(f(ground, predicted));
+            }
+            set_counters(state, n, 2*sizeof(T));
+        })->RangeMultiplier(8)->Range(min_size, max_size<T>);
+    }
+
+    template <typename T, typename F>
+    void add_activation (std::string const& name, F f) {
+        // f(in, out) over n elements, read once and written once
+        benchmark::RegisterBenchmark(("activation/" + name + "/" + type_name<T>).c_str(), [f](benchmark::State& state) {
+            auto& data = inputs<T>::get();
+            std::size_t n = state.range(0);
+            std::span<T const> in(data.z.data(), n);
+            std::span<T> out(data.out.data(), n);
+            for (auto _ : state) {
+                f(in, out);
+                benchmark::ClobberMemory();
+            }
+            set_counters(state, n, 2*sizeof(T));
+        })->RangeMultiplier(8)->Range(min_size, max_size<T>);
+    }
+
+    template <quantized::byte Q>
+    void add_lookup (std::string const& name, quantized::table<Q> const& t) {
+        // a table lookup over n bytes of z quantized with scale 1/16
+        constexpr char const* byte_name = std::is_same_v<Q, std::int8_t> ? "int8" : "uint8";
+        benchmark::RegisterBenchmark(("quantized/" + name + "/" + byte_name).c_str(), [t](benchmark::State& state) {
+            static std::vector<Q> const z = [] {
+                auto const& data = inputs<float>::get();
+                std::vector<Q> q(max_size<Q>);
+                long zero = std::is_same_v<Q, std::int8_t> ? 0 : 128;
+                std::transform(data.z.begin(), data.z.begin() + max_size<Q>, q.begin(), [zero](float v) {
+                    return Q(std::clamp<long>(std::lrint(v*16) + zero, std::numeric_limits<Q>::min(), std::numeric_limits<Q>::max()));
+                });
+                return q;
+            }();
+            static std::vector<Q> out(max_size<Q>);
+            std::size_t n = state.range(0);
+            for (auto _ : state) {
+                quantized::lookup<Q>(t, std::span<Q const>(z.data(), n), std::span<Q>(out.data(), n));
+                benchmark::ClobberMemory();
+            }
+            set_counters(state, n, 2);
+        })->RangeMultiplier(8)->Range(min_size, max_size<Q>);
+    }
+
+    template <typename T, typename F>
+    void add_dense (std::string const& name, F f) {
+        // f(x, w, bias, y) for a square [n, n] batch and [n, n] weights. the
+        // weights are centered and scaled by 1/sqrt(n) as at initialization,
+        // so the outputs have the spread of real pre-activations
+        benchmark::RegisterBenchmark(("layer/" + name + "/" + type_name<T>).c_str(), [f](benchmark::State& state) {
+            auto& data = inputs<T>::get();
+            std::size_t n = state.range(0);
+            std::span<T const> x(data.z.data(), n*n), bias(data.ground.data(), n);
+            std::vector<T> centered(data.predicted.begin(), data.predicted.begin() + n*n);
+            for (T& v : centered) v = (v - T(0.5))/std::sqrt(T(n));
+            layer::weights<T> w(std::span<T const>(centered), n);
+            std::span<T> y(data.out.data(), n*n);
+            for (auto _ : state) {
+                f(x, w, bias, y);
+                benchmark::ClobberMemory();
+            }
+            state.counters["flops"] = benchmark::Counter(2.0*n*n*n,
+                benchmark::Counter::kIsIterationInvariantRate);
+        })->RangeMultiplier(4)->Range(16, 1024);
+    }
+
+    template <typename T>
+    void register_losses () {
+        using span = std::span<T const>;
+
+        add_loss<T>("L1", [](span g, span p) { return loss::L1(g, p); });
+        add_loss<T>("L1_f", [](span g, span p) { return loss::L1_f(g, p); });
+        add_loss<T>("L2", [](span g, span p) { return loss::L2(g, p); });
+        add_loss<T>("L2_f", [](span g, span p) { return loss::L2_f(g, p); });
+        add_loss<T>("huber", [](span g, span p) { return loss::huber(g, p, T(0.2)); });
+        add_loss<T>("huber_f", [](span g, span p) { return loss::huber_f(g, p, T(0.2)); });
+        add_loss<T>("bce", [](span g, span p) { return loss::bce(g, p); });
+        add_loss<T>("bce_f", [](span g, span p) { return loss::bce_f(g, p); });
+        add_loss<T>("ce", [](span g, span p) { return loss::ce(g, p); });
+        add_loss<T>("ce_f", [](span g, span p) { return loss::ce_f(g, p); });
+        add_loss<T>("kl", [](span g, span p) { return loss::kl(g, p); });
+        add_loss<T>("hinge", [](span g, span p) { return loss::hinge(g, p); });
+        add_loss<T>("contrastive", [](span g, span p) { return loss::contrastive(false, g, p, T(2)); });
+        add_loss<T>("tr", [](span g, span p) { return loss::tr(g, p, g, T(0.2)); });
+
+        // the same reduction with the other summation policies and the thread pool
+        add_loss<T>("L1_f/kahan", [](span g, span p) { return loss::L1_f<loss::summation::kahan>(g, p); });
+        add_loss<T>("L1_f/pairwise", [](span g, span p) { return loss::L1_f<loss::summation::pairwise>(g, p); });
+        add_loss<T>("L1_f/parallel", [](span g, span p) { return loss::L1_f(g, p, loss::execution::parallel); });
+
+        // accumulated in double whatever T is, over the lanes of a naive sum
+        using mixed = loss::summation::mixed<double>;
+        add_loss<T>("L1/mixed", [](span g, span p) { return loss::L1<mixed>(g, p); });
+        add_loss<T>("L2/mixed", [](span g, span p) { return loss::L2<mixed>(g, p); });
+        add_loss<T>("bce/mixed", [](span g, span p) { return loss::bce<mixed>(g, p); });
+        add_loss<T>("ce/mixed", [](span g, span p) { return loss::ce<mixed>(g, p); });
+
+        // logits based, the predicted range doubles as logits
+        add_loss<T>("logsumexp", [](span, span p) { return loss::logsumexp<T>(p); });
+        add_loss<T>("ce_from_logits", [](span g, span p) { return loss::ce_from_logits<T>(g, p); });
+        add_loss<T>("bce_with_logits", [](span g, span p) { return loss::bce_with_logits<T>(g, p); });
+    }
+
+    template <typename T>
+    void register_activations () {
+        using in_span = std::span<T const>;
+        using out_span = std::span<T>;
+
+        // span kernels next to a plain loop over the scalar function
+        auto add = [](std::string const& name, auto kernel, auto scalar) {
+            add_activation<T>(name, kernel);
+            add_activation<T>(name + "/scalar", [scalar](in_span in, out_span out) {
+                std::transform(in.begin(), in.end(), out.begin(), scalar);
+            });
+        };
+
+        add("sigmoid", [](in_span in, out_span out) { activation::sigmoid<T>(in, out); },
+                       [](T z) { return activation::sigmoid(z); });
+        add("tanh", [](in_span in, out_span out) { activation::tanh<T>(in, out); },
+                    [](T z) { return activation::tanh(z); });
+        add("relu", [](in_span in, out_span out) { activation::relu<T>(in, out); },
+                    [](T z) { return activation::relu(z); });
+        add("prelu", [](in_span in, out_span out) { activation::prelu<T>(in, out, T(0.1)); },
+                     [](T z) { return activation::prelu(z, T(0.1)); });
+        add("elu", [](in_span in, out_span out) { activation::elu<T>(in, out, T(0.1)); },
+                   [](T z) { return activation::elu(z, T(0.1)); });
+        add("glu", [](in_span in, out_span out) { activation::glu<T>(in, out); },
+                   [](T z) { return activation::glu(z); });
+        add("swish", [](in_span in, out_span out) { activation::swish<T>(in, out); },
+                     [](T z) { return activation::swish(z); });
+        add("softplus", [](in_span in, out_span out) { activation::softplus<T>(in, out, T(1)); },
+                        [](T z) { return activation::softplus(z, T(1)); });
+        add("mish", [](in_span in, out_span out) { activation::mish<T>(in, out); },
+                    [](T z) { return activation::mish(z); });
+        add("gelu", [](in_span in, out_span out) { activation::gelu<T>(in, out); },
+                    [](T z) { return activation::gelu(z); });
+        add("gelu_tanh", [](in_span in, out_span out) { activation::gelu_tanh<T>(in, out); },
+                         [](T z) { return activation::gelu_tanh(z); });
+        add("hard_swish", [](in_span in, out_span out) { activation::hard_swish<T>(in, out); },
+                          [](T z) { return activation::hard_swish(z); });
+        add("leaky_relu", [](in_span in, out_span out) { activation::leaky_relu<T>(in, out); },
+                          [](T z) { return activation::leaky_relu(z); });
+        add("selu", [](in_span in, out_span out) { activation::selu<T>(in, out); },
+                    [](T z) { return activation::selu(z); });
+        add("softsign", [](in_span in, out_span out) { activation::softsign<T>(in, out); },
+                        [](T z) { return activation::softsign(z); });
+
+        // the approximate accuracy policies of the exp/tanh based kernels
+        using activation::accuracy::ulp3, activation::accuracy::fast;
+        add_activation<T>("sigmoid/ulp3", [](in_span in, out_span out) { activation::sigmoid<T, ulp3>(in, out); });
+        add_activation<T>("sigmoid/fast", [](in_span in, out_span out) { activation::sigmoid<T, fast>(in, out); });
+        add_activation<T>("tanh/ulp3", [](in_span in, out_span out) { activation::tanh<T, ulp3>(in, out); });
+        add_activation<T>("tanh/fast", [](in_span in, out_span out) { activation::tanh<T, fast>(in, out); });
+        add_activation<T>("softplus/ulp3", [](in_span in, out_span out) { activation::softplus<T, ulp3>(in, out, T(1)); });
+        add_activation<T>("softplus/fast", [](in_span in, out_span out) { activation::softplus<T, fast>(in, out, T(1)); });
+        add_activation<T>("mish/ulp3", [](in_span in, out_span out) { activation::mish<T, ulp3>(in, out); });
+        add_activation<T>("mish/fast", [](in_span in, out_span out) { activation::mish<T, fast>(in, out); });
+        add_activation<T>("gelu/ulp3", [](in_span in, out_span out) { activation::gelu<T, ulp3>(in, out); });
+        add_activation<T>("gelu/fast", [](in_span in, out_span out) { activation::gelu<T, fast>(in, out); });
+
+        // gated units over [n/2d, 2d] rows, the outputs fill half of out
+        auto gated_width = [](in_span in) { return std::min<std::size_t>(in.size()/2, 1024); };
+        add_activation<T>("gated/glu", [=](in_span in, out_span out) { activation::gated::glu<T>(in, out, gated_width(in)); });
+        add_activation<T>("gated/swiglu", [=](in_span in, out_span out) { activation::gated::swiglu<T>(in, out, gated_width(in)); });
+        add_activation<T>("gated/geglu", [=](in_span in, out_span out) { activation::gated::geglu<T>(in, out, gated_width(in)); });
+        add_activation<T>("gated/reglu", [=](in_span in, out_span out) { activation::gated::reglu<T>(in, out, gated_width(in)); });
+        add_activation<T>("gated/swiglu/backward", [=](in_span in, out_span out) {
+            // the gradient of the outputs is read from the front of in
+            activation::gated::swiglu_backward<T>(in, in.first(in.size()/2), out, gated_width(in));
+        });
+
+        // per-channel alpha over up to 64 channels of n/channels values each
+        using activation::channel::layout;
+        static std::vector<T> const alpha(64, T(0.25));
+        static std::vector<T> grad_alpha(64);
+        auto channels = [](in_span in) { return std::span<T const>(alpha).first(std::min<std::size_t>(in.size(), 64)); };
+        auto spatial = [=](in_span in) { return in.size()/channels(in).size(); };
+        for (auto [order, name] : {std::pair{layout::nchw, "nchw"}, std::pair{layout::nhwc, "nhwc"}}) {
+            add_activation<T>(std::string("channel/prelu/") + name, [=](in_span in, out_span out) {
+                activation::channel::prelu<T>(in, out, channels(in), spatial(in), order);
+            });
+            add_activation<T>(std::string("channel/elu/") + name, [=](in_span in, out_span out) {
+                activation::channel::elu<T>(in, out, channels(in), spatial(in), order);
+            });
+            add_activation<T>(std::string("channel/prelu/backward/") + name, [=](in_span in, out_span out) {
+                // the gradient of the outputs is in itself
+                activation::channel::prelu_backward<T>(in, in, out, grad_alpha, channels(in), spatial(in), order);
+            });
+        }
+    }
+
+    template <typename T>
+    void register_layers () {
+        using span = std::span<T const>;
+        using out_span = std::span<T>;
+
+        // the activation in the gemm epilogue against a second pass over y
+        add_dense<T>("dense", [](span x, layer::weights<T> const& w, span b, out_span y) {
+            layer::dense<T>(x, w, b, y);
+        });
+        add_dense<T>("dense/elu", [](span x, layer::weights<T> const& w, span b, out_span y) {
+            layer::dense<T>(x, w, b, y, layer::epilogue::elu<>{0.1});
+        });
+        add_dense<T>("dense/elu/unfused", [](span x, layer::weights<T> const& w, span b, out_span y) {
+            layer::dense<T>(x, w, b, y);
+            activation::elu<T>(y, T(0.1));
+        });
+        add_dense<T>("dense/mish", [](span x, layer::weights<T> const& w, span b, out_span y) {
+            layer::dense<T>(x, w, b, y, layer::epilogue::mish<>{});
+        });
+        add_dense<T>("dense/mish/unfused", [](span x, layer::weights<T> const& w, span b, out_span y) {
+            layer::dense<T>(x, w, b, y);
+            activation::mish<T>(y);
+        });
+    }
+
+    template <half::storage H>
+    void register_half () {
+        using in_span = std::span<H const>;
+        using out_span = std::span<H>;
+        using widened = half::widened<H>;
+
+        // the conversions alone, the byte counters only see the 16-bit side
+        add_activation<H>("widen", [](in_span in, out_span) {
+            half::widen<H>(in, std::span<float>(inputs<float>::get().out).first(in.size()));
+        });
+        add_activation<H>("narrow", [](in_span in, out_span out) {
+            half::narrow<H>(std::span<float const>(inputs<float>::get().z).first(in.size()), out);
+        });
+
+        // the float kernels over blocks widened on the stack
+        add_activation<H>("sigmoid", [](in_span in, out_span out) {
+            half::apply<H>(in, out, [](auto z, auto y) { activation::sigmoid<float>(z, y); });
+        });
+        add_activation<H>("relu", [](in_span in, out_span out) {
+            half::apply<H>(in, out, [](auto z, auto y) { activation::relu<float>(z, y); });
+        });
+        add_activation<H>("mish", [](in_span in, out_span out) {
+            half::apply<H>(in, out, [](auto z, auto y) { activation::mish<float>(z, y); });
+        });
+        add_activation<H>("gelu", [](in_span in, out_span out) {
+            half::apply<H>(in, out, [](auto z, auto y) { activation::gelu<float>(z, y); });
+        });
+        add_activation<H>("gated/swiglu", [](in_span in, out_span out) {
+            half::gated<H>(in, out, std::min<std::size_t>(in.size()/2, 1024), [](auto a, auto y, std::size_t d) {
+                activation::gated::swiglu<float>(a, y, d);
+            });
+        });
+        static std::vector<float> const alpha(64, 0.25f);
+        add_activation<H>("channel/prelu/nchw", [](in_span in, out_span out) {
+            auto channels = std::span<float const>(alpha).first(std::min<std::size_t>(in.size(), 64));
+            half::channel<H>(in, out, channels, in.size()/channels.size(), activation::channel::layout::nchw,
+                [](auto z, auto y, auto a, std::size_t spatial, auto order) { activation::channel::prelu<float>(z, y, a, spatial, order); });
+        });
+
+        // the range losses read through a widening view and accumulate in float
+        add_loss<H>("L1", [](in_span g, in_span p) { return loss::L1(widened(g), widened(p)); });
+        add_loss<H>("L2", [](in_span g, in_span p) { return loss::L2(widened(g), widened(p)); });
+        add_loss<H>("bce", [](in_span g, in_span p) { return loss::bce(widened(g), widened(p)); });
+        add_loss<H>("ce", [](in_span g, in_span p) { return loss::ce(widened(g), widened(p)); });
+        add_loss<H>("kl", [](in_span g, in_span p) { return loss::kl(widened(g), widened(p)); });
+        add_loss<H>("L1/mixed", [](in_span g, in_span p) {
+            return loss::L1<loss::summation::mixed<float>>(widened(g), widened(p));
+        });
+        add_loss<H>("L2/mixed", [](in_span g, in_span p) {
+            return loss::L2<loss::summation::mixed<float>>(widened(g), widened(p));
+        });
+    }
+
+    template <quantized::byte Q>
+    void register_quantized () {
+        // inputs over [-8, 8], outputs over [0, 1) and [-1, 1)
+        std::int32_t zero = std::is_same_v<Q, std::int8_t> ? 0 : 128;
+        quantized::quantization in{1.0f/16, zero}, unit{1.0f/256, zero - 128}, symmetric{1.0f/128, zero};
+        add_lookup<Q>("sigmoid", quantized::sigmoid<Q>(in, unit));
+        add_lookup<Q>("tanh", quantized::tanh<Q>(in, symmetric));
+        add_lookup<Q>("elu", quantized::elu<Q>(in, in, 0.1f));
+    }
+}
+
+int main (int argc, char** argv) {
+    register_losses<float>();
+    register_losses<double>();
+    register_activations<float>();
+    register_activations<double>();
+    register_layers<float>();
+    register_layers<double>();
+    register_half<half::float16>();
+    register_half<half::bfloat16>();
+    register_quantized<std::int8_t>();
+    register_quantized<std::uint8_t>();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
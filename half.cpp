@@ -0,0 +1,55 @@
+#include <iostream>
+#include <vector>
+
+#include "half.hpp"
+
+int main () {
+    auto print_range = []<typename Range>(Range const& r) -> void {
+        std::cout << "{ ";
+        for (auto v : r) {
+            std::cout << half::widen(v) << " ";
+        }
+        std::cout << "}" << std::endl;
+    };
+
+    std::vector<float> zs = {-2.0f, -0.5f, 0.0f, 0.5f, 2.0f, 70000.0f};
+    std::vector<half::float16> z16(zs.size()), out16(zs.size()), grad16(zs.size());
+    std::vector<half::bfloat16> zb(zs.size()), outb(zs.size());
+    half::narrow<half::float16>(zs, z16);
+    half::narrow<half::bfloat16>(zs, zb);
+    std::cout << "zs, f16 = "; print_range(z16);
+    std::cout << "zs, bf16 = "; print_range(zb);
+
+    // the kernels run in float on blocks widened on the stack
+    half::apply<half::float16>(z16, out16, [](auto z, auto y) { activation::gelu<float>(z, y); });
+    std::cout << "gelu(zs), f16 = "; print_range(out16);
+    half::apply<half::bfloat16>(zb, outb, [](auto z, auto y) { activation::sigmoid<float>(z, y); });
+    std::cout << "sigmoid(zs), bf16 = "; print_range(outb);
+    half::apply<half::float16>(z16, out16, grad16, [](auto z, auto y, auto g) { activation::mish_forward<float>(z, y, g); });
+    std::cout << "mish'(zs), f16 = "; print_range(grad16);
+
+    // a swiglu over two rows of [value | gate] and a per-channel prelu, bf16
+    std::vector<half::bfloat16> halves(8), gated(4);
+    half::narrow<half::bfloat16>(std::vector<float>{1.0f, -2.0f, 0.5f, 3.0f, 0.3f, 0.1f, -1.0f, 2.0f}, halves);
+    half::gated<half::bfloat16>(halves, gated, 2, [](auto in, auto out, std::size_t d) {
+        activation::gated::swiglu<float>(in, out, d);
+    });
+    std::cout << "swiglu(halves), bf16 = "; print_range(gated);
+    std::vector<float> alpha = {0.1f, 0.2f};
+    std::vector<half::bfloat16> image(6);
+    half::narrow<half::bfloat16>(std::vector<float>{1.0f, -2.0f, 0.5f, -1.0f, 3.0f, -0.5f}, image);
+    half::channel<half::bfloat16>(image, image, alpha, 3, activation::channel::layout::nchw,
+        [](auto in, auto out, auto a, std::size_t spatial, auto order) { activation::channel::prelu<float>(in, out, a, spatial, order); });
+    std::cout << "prelu(image, alpha) in-place, bf16 = "; print_range(image);
+
+    // losses read f16 data through a widening view and accumulate in float
+    std::vector<float> g = {0.1f, 0.9f, 0.4f}, p = {0.2f, 0.7f, 0.5f};
+    std::vector<half::float16> g16(3), p16(3);
+    half::narrow<half::float16>(g, g16);
+    half::narrow<half::float16>(p, p16);
+    half::widened<half::float16> ground(g16), predicted(p16);
+    std::cout << "bce, f16 = " << loss::bce(ground, predicted) << ", float = " << loss::bce(g, p) << std::endl;
+    std::cout << "L2, f16 = " << loss::L2(ground, predicted) << ", float = " << loss::L2(g, p) << std::endl;
+
+    return 0;
+}
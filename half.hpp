@@ -0,0 +1,397 @@
+#pragma once
+
+#include <concepts>
+
+#include <bit>
+#include <span>
+#include <ranges>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <version>
+
+#if __has_include(<stdfloat>)
+#include <stdfloat>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "activation.hpp"
+#include "loss.hpp"
+
+namespace half {
+    // 16-bit floating point storage with f32 compute. ieee binary16 and
+    // bfloat16 halve the bytes of a tensor, the math stays in float: spans
+    // are widened block by block into a buffer on the stack, the float
+    // kernels of activation run on it and the results are narrowed back,
+    // losses read their ranges through a widening view. conversions are
+    // vcvtph2ps/vcvtps2ph with f16c or avx512 and vcvtneps2bf16 with
+    // avx512 bf16, the rest are bit manipulations that vectorize on their
+    // own. narrowing rounds to nearest even
+
+#if defined(__STDCPP_FLOAT16_T__)
+    using float16 = std::float16_t;
+#elif defined(__FLT16_MAX__)
+    using float16 = _Float16;
+#else
+    struct float16 { std::uint16_t bits; };
+#endif
+
+#if defined(__STDCPP_BFLOAT16_T__)
+    using bfloat16 = std::bfloat16_t;
+#else
+    // the upper half of a binary32
+    struct bfloat16 { std::uint16_t bits; };
+#endif
+
+    template <typename H>
+    concept storage = (std::same_as<H, float16> || std::same_as<H, bfloat16>) && sizeof(H) == 2;
+
+    namespace bits {
+        // conversions on the bit patterns, branch-free so the loops over
+        // them vectorize. a mask is all ones where its condition holds
+
+        static constexpr std::uint32_t pick (std::uint32_t mask, std::uint32_t a, std::uint32_t b) {
+            return (a & mask) | (b & ~mask);
+        }
+
+        static constexpr float widen_f16 (std::uint16_t h) {
+            // exponent and mantissa shifted into place and scaled by 2^112
+            // rebias the exponent, subnormals come out of the multiply
+            // normalized. inf and nan keep an all-ones exponent
+            std::uint32_t sign = std::uint32_t(h & 0x8000) << 16;
+            std::uint32_t em = std::uint32_t(h & 0x7fff) << 13;
+            std::uint32_t scaled = std::bit_cast<std::uint32_t>(std::bit_cast<float>(em)*0x1p112f);
+            std::uint32_t special = -std::uint32_t(em >= 0x0f800000);
+            return std::bit_cast<float>(pick(special, em | 0x7f800000, scaled) | sign);
+        }
+
+        static constexpr std::uint16_t narrow_f16 (float x) {
+            std::uint32_t u = std::bit_cast<std::uint32_t>(x);
+            std::uint32_t sign = (u >> 16) & 0x8000;
+            u &= 0x7fffffff;
+            // normals: rebias by (15 - 127) << 23, then round the 13
+            // dropped bits to nearest even
+            std::uint32_t normal = (u + 0xc8000fff + ((u >> 13) & 1)) >> 13;
+            // subnormals: adding 0.5 makes the fpu round the value into
+            // the low mantissa bits
+            std::uint32_t subnormal = std::bit_cast<std::uint32_t>(std::bit_cast<float>(u) + 0.5f) - 0x3f000000;
+            // from 65536 up overflow to inf, nan stays a quiet nan
+            std::uint32_t special = pick(-std::uint32_t(u > 0x7f800000), 0x7e00, 0x7c00);
+            std::uint32_t h = pick(-std::uint32_t(u < 0x38800000), subnormal, normal);
+            return std::uint16_t(pick(-std::uint32_t(u >= 0x47800000), special, h) | sign);
+        }
+
+        static constexpr float widen_bf16 (std::uint16_t h) {
+            return std::bit_cast<float>(std::uint32_t(h) << 16);
+        }
+
+        static constexpr std::uint16_t narrow_bf16 (float x) {
+            std::uint32_t u = std::bit_cast<std::uint32_t>(x);
+            std::uint32_t rounded = (u + 0x7fff + ((u >> 16) & 1)) >> 16;
+            std::uint32_t nan = (u >> 16) | 0x40;
+            return std::uint16_t(pick(-std::uint32_t((u & 0x7fffffff) > 0x7f800000), nan, rounded));
+        }
+    }
+
+    template <storage H>
+    static constexpr float widen (H h) {
+        std::uint16_t b = std::bit_cast<std::uint16_t>(h);
+        if constexpr (std::same_as<H, float16>) {
+            return bits::widen_f16(b);
+        } else {
+            return bits::widen_bf16(b);
+        }
+    }
+
+    template <storage H>
+    static constexpr H narrow (float x) {
+        if constexpr (std::same_as<H, float16>) {
+            return std::bit_cast<H>(bits::narrow_f16(x));
+        } else {
+            return std::bit_cast<H>(bits::narrow_bf16(x));
+        }
+    }
+
+    namespace kernel {
+        // bulk conversions, dispatched at runtime as activation::kernel::loop.
+        // the generic loops go through activation::kernel::loop as well and
+        // are vectorized for whichever isa it picks
+
+        static void widen_f16_generic (std::uint16_t const* x, float* y, std::size_t n) {
+            activation::kernel::loop(n, [=](std::size_t i) { y[i] = bits::widen_f16(x[i]); });
+        }
+
+        static void narrow_f16_generic (float const* x, std::uint16_t* y, std::size_t n) {
+            activation::kernel::loop(n, [=](std::size_t i) { y[i] = bits::narrow_f16(x[i]); });
+        }
+
+        static void widen_bf16 (std::uint16_t const* x, float* y, std::size_t n) {
+            activation::kernel::loop(n, [=](std::size_t i) { y[i] = bits::widen_bf16(x[i]); });
+        }
+
+        static void narrow_bf16_generic (float const* x, std::uint16_t* y, std::size_t n) {
+            activation::kernel::loop(n, [=](std::size_t i) { y[i] = bits::narrow_bf16(x[i]); });
+        }
+
+    #if defined(__x86_64__) || defined(__i386__)
+        static bool f16c () {
+            static bool const s = [] {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("f16c");
+            }();
+            return s;
+        }
+
+        static bool bf16 () {
+            static bool const s = [] {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx512bf16") && __builtin_cpu_supports("avx512f");
+            }();
+            return s;
+        }
+
+        [[gnu::target("avx2,fma,f16c")]]
+        static void widen_f16_f16c (std::uint16_t const* x, float* y, std::size_t n) {
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                _mm256_storeu_ps(y + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<__m128i const*>(x + i))));
+            }
+            for (; i < n; ++i) y[i] = bits::widen_f16(x[i]);
+        }
+
+        [[gnu::target("avx2,fma,f16c")]]
+        static void narrow_f16_f16c (float const* x, std::uint16_t* y, std::size_t n) {
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i), _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+            }
+            for (; i < n; ++i) y[i] = bits::narrow_f16(x[i]);
+        }
+
+        // the zero-masked forms with every lane set are the plain
+        // conversions, gcc 12 warns on the undefined source of the others
+
+        [[gnu::target("avx512f,avx512dq")]]
+        static void widen_f16_avx512 (std::uint16_t const* x, float* y, std::size_t n) {
+            std::size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m256i h = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(x + i));
+                _mm512_storeu_ps(y + i, _mm512_maskz_cvtph_ps(__mmask16(0xffff), h));
+            }
+            for (; i < n; ++i) y[i] = bits::widen_f16(x[i]);
+        }
+
+        [[gnu::target("avx512f,avx512dq")]]
+        static void narrow_f16_avx512 (float const* x, std::uint16_t* y, std::size_t n) {
+            std::size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                __m256i h = _mm512_maskz_cvtps_ph(__mmask16(0xffff), _mm512_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), h);
+            }
+            for (; i < n; ++i) y[i] = bits::narrow_f16(x[i]);
+        }
+
+        [[gnu::target("avx512f,avx512bf16")]]
+        static void narrow_bf16_avx512 (float const* x, std::uint16_t* y, std::size_t n) {
+            // vcvtneps2bf16 flushes subnormal inputs and results to zero,
+            // below 2^-126 it differs from the generic loop
+            std::size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), (__m256i)_mm512_cvtneps_pbh(_mm512_loadu_ps(x + i)));
+            }
+            for (; i < n; ++i) y[i] = bits::narrow_bf16(x[i]);
+        }
+    #endif
+
+        static void widen_f16 (std::uint16_t const* x, float* y, std::size_t n) {
+        #if defined(__x86_64__) || defined(__i386__)
+            if (activation::kernel::selected() == activation::kernel::isa::avx512) {
+                return widen_f16_avx512(x, y, n);
+            }
+            if (activation::kernel::selected() == activation::kernel::isa::avx2 && f16c()) {
+                return widen_f16_f16c(x, y, n);
+            }
+        #endif
+            widen_f16_generic(x, y, n);
+        }
+
+        static void narrow_f16 (float const* x, std::uint16_t* y, std::size_t n) {
+        #if defined(__x86_64__) || defined(__i386__)
+            if (activation::kernel::selected() == activation::kernel::isa::avx512) {
+                return narrow_f16_avx512(x, y, n);
+            }
+            if (activation::kernel::selected() == activation::kernel::isa::avx2 && f16c()) {
+                return narrow_f16_f16c(x, y, n);
+            }
+        #endif
+            narrow_f16_generic(x, y, n);
+        }
+
+        static void narrow_bf16 (float const* x, std::uint16_t* y, std::size_t n) {
+        #if defined(__x86_64__) || defined(__i386__)
+            if (bf16()) {
+                return narrow_bf16_avx512(x, y, n);
+            }
+        #endif
+            narrow_bf16_generic(x, y, n);
+        }
+    }
+
+    template <storage H>
+    static void widen (std::span<H const> in, std::span<float> out) {
+        assert(out.size() >= in.size());
+        auto x = reinterpret_cast<std::uint16_t const*>(in.data());
+        if constexpr (std::same_as<H, float16>) {
+            kernel::widen_f16(x, out.data(), in.size());
+        } else {
+            kernel::widen_bf16(x, out.data(), in.size());
+        }
+    }
+
+    template <storage H>
+    static void narrow (std::span<float const> in, std::span<H> out) {
+        assert(out.size() >= in.size());
+        auto y = reinterpret_cast<std::uint16_t*>(out.data());
+        if constexpr (std::same_as<H, float16>) {
+            kernel::narrow_f16(in.data(), y, in.size());
+        } else {
+            kernel::narrow_bf16(in.data(), y, in.size());
+        }
+    }
+
+    // activations. f is the float span kernel, for instance
+    //   half::apply<half::bfloat16>(in, out, [](auto z, auto y) { activation::gelu<float>(z, y); });
+    // blocks of 4 KiB of floats stay in l1 between the widening, the kernel
+    // and the narrowing, so memory only sees the 16-bit tensors. gradients
+    // are left to the float kernels, mixed precision keeps them in f32
+
+    inline constexpr std::size_t block = 1024;
+
+    template <storage H, typename F>
+    static void apply (std::span<H const> in, std::span<H> out, F f) {
+        // f(in, out) over float spans, elementwise. in and out may be the
+        // same buffer
+        assert(out.size() >= in.size());
+        alignas(64) float z[block];
+        for (std::size_t first = 0; first < in.size(); first += block) {
+            std::size_t n = std::min(block, in.size() - first);
+            half::widen<H>(in.subspan(first, n), std::span<float>(z, n));
+            f(std::span<float const>(z, n), std::span<float>(z, n));
+            half::narrow<H>(std::span<float const>(z, n), out.subspan(first, n));
+        }
+    }
+
+    template <storage H, typename F>
+    static void apply (std::span<H const> in, std::span<H> out, std::span<H> out2, F f) {
+        // f(in, out, out2) over float spans, for the *_forward kernels that
+        // return the value and the derivative
+        assert(out.size() >= in.size() && out2.size() >= in.size());
+        alignas(64) float z[block], z2[block];
+        for (std::size_t first = 0; first < in.size(); first += block) {
+            std::size_t n = std::min(block, in.size() - first);
+            half::widen<H>(in.subspan(first, n), std::span<float>(z, n));
+            f(std::span<float const>(z, n), std::span<float>(z, n), std::span<float>(z2, n));
+            half::narrow<H>(std::span<float const>(z, n), out.subspan(first, n));
+            half::narrow<H>(std::span<float const>(z2, n), out2.subspan(first, n));
+        }
+    }
+
+    template <storage H, typename F>
+    static void gated (std::span<H const> in, std::span<H> out, std::size_t d, F f) {
+        // f(in, out, d) is a kernel of activation::gated over rows of [a | b].
+        // a block holds whole rows when a row fits, a longer row is split
+        // into blocks of matching columns of a and b. out may be the front
+        // of in
+        assert(d > 0 && in.size() % (2*d) == 0 && out.size() >= in.size()/2);
+        alignas(64) float z[block], y[block/2];
+        std::size_t rows = in.size()/(2*d);
+        if (2*d <= block) {
+            for (std::size_t row = 0; row < rows; row += block/(2*d)) {
+                std::size_t k = std::min(block/(2*d), rows - row);
+                half::widen<H>(in.subspan(2*d*row, 2*d*k), std::span<float>(z, 2*d*k));
+                f(std::span<float const>(z, 2*d*k), std::span<float>(y, d*k), d);
+                half::narrow<H>(std::span<float const>(y, d*k), out.subspan(d*row, d*k));
+            }
+            return;
+        }
+        for (std::size_t row = 0; row < rows; ++row) {
+            for (std::size_t c = 0; c < d; c += block/2) {
+                std::size_t m = std::min(block/2, d - c);
+                half::widen<H>(in.subspan(2*d*row + c, m), std::span<float>(z, m));
+                half::widen<H>(in.subspan(2*d*row + d + c, m), std::span<float>(z + m, m));
+                f(std::span<float const>(z, 2*m), std::span<float>(y, m), m);
+                half::narrow<H>(std::span<float const>(y, m), out.subspan(d*row + c, m));
+            }
+        }
+    }
+
+    template <storage H, typename F>
+    static void channel (std::span<H const> in, std::span<H> out, std::span<float const> alpha, std::size_t spatial,
+                         activation::channel::layout order, F f) {
+        // f(in, out, alpha, spatial, order) is a kernel of activation::channel.
+        // a block holds whole runs, nchw channels of one image or nhwc pixels,
+        // and f sees the alpha of those runs only. a longer run is split
+        std::size_t channels = alpha.size();
+        assert(channels > 0 && spatial > 0 && in.size() % (channels*spatial) == 0 && out.size() >= in.size());
+        alignas(64) float z[block];
+        auto run = [&](std::size_t first, std::size_t n, std::span<float const> a, std::size_t s) {
+            half::widen<H>(in.subspan(first, n), std::span<float>(z, n));
+            f(std::span<float const>(z, n), std::span<float>(z, n), a, s, order);
+            half::narrow<H>(std::span<float const>(z, n), out.subspan(first, n));
+        };
+        if (order == activation::channel::layout::nchw) {
+            std::size_t runs = in.size()/spatial;
+            for (std::size_t r = 0; r < runs;) {
+                std::size_t c = r % channels;
+                if (spatial <= block) {
+                    std::size_t k = std::min({block/spatial, channels - c, runs - r});
+                    run(spatial*r, spatial*k, alpha.subspan(c, k), spatial);
+                    r += k;
+                    continue;
+                }
+                for (std::size_t i = 0; i < spatial; i += block) {
+                    std::size_t m = std::min(block, spatial - i);
+                    run(spatial*r + i, m, alpha.subspan(c, 1), m);
+                }
+                ++r;
+            }
+        } else {
+            std::size_t pixels = in.size()/channels;
+            for (std::size_t p = 0; p < pixels;) {
+                if (channels <= block) {
+                    std::size_t k = std::min(block/channels, pixels - p);
+                    run(channels*p, channels*k, alpha, k);
+                    p += k;
+                    continue;
+                }
+                for (std::size_t c = 0; c < channels; c += block) {
+                    std::size_t m = std::min(block, channels - c);
+                    run(channels*p + c, m, alpha.subspan(c, m), 1);
+                }
+                ++p;
+            }
+        }
+    }
+
+    // losses. a widened range reads as floats, so the range templates of
+    // loss compute and accumulate in f32 and write f32 gradients, as in
+    //   loss::bce(half::widened<half::float16>(ground), half::widened<half::float16>(predicted));
+    // the span kernels over logits take rows widened with half::widen
+
+    template <storage H>
+    struct widening {
+        constexpr float operator() (H h) const { return half::widen(h); }
+    };
+
+    template <storage H>
+    struct widened : std::ranges::transform_view<std::span<H const>, widening<H>> {
+        using value_type = float;
+
+        constexpr widened (std::span<H const> s)
+            : std::ranges::transform_view<std::span<H const>, widening<H>>(s, widening<H>{}) {}
+    };
+}
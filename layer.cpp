@@ -0,0 +1,48 @@
+#include <iostream>
+#include <vector>
+
+#include "layer.hpp"
+
+int main () {
+    // a batch of 3 samples through a 4 -> 5 dense layer
+    std::vector<float> x = {
+        1.0f, -2.0f, 0.5f, 0.0f,
+        0.3f, 0.1f, -0.4f, 2.0f,
+        -1.0f, 1.0f, 1.0f, -1.0f,
+    };
+    std::vector<float> w = {
+        0.2f, -0.1f, 0.4f, 0.0f, 0.3f,
+        -0.5f, 0.2f, 0.1f, 0.3f, -0.2f,
+        0.1f, 0.1f, -0.3f, 0.2f, 0.5f,
+        0.0f, -0.4f, 0.2f, 0.1f, 0.1f,
+    };
+    std::vector<float> bias = {0.1f, 0.0f, -0.1f, 0.2f, 0.0f};
+    std::vector<float> y(3*5);
+
+    auto print_rows = [](std::vector<float> const& m, std::size_t cols) -> void {
+        for (std::size_t r = 0; r < m.size(); r += cols) {
+            std::cout << "  { ";
+            for (std::size_t c = 0; c < cols; ++c) {
+                std::cout << m[r + c] << " ";
+            }
+            std::cout << "}" << std::endl;
+        }
+    };
+
+    // the weights are packed once and reused by every call
+    layer::weights<float> packed(w, 5);
+
+    layer::dense<float>(x, packed, bias, y);
+    std::cout << "x*w + b =" << std::endl; print_rows(y, 5);
+
+    layer::dense<float>(x, packed, bias, y, layer::epilogue::relu{});
+    std::cout << "relu(x*w + b) =" << std::endl; print_rows(y, 5);
+
+    layer::dense<float>(x, packed, bias, y, layer::epilogue::elu<>{0.1});
+    std::cout << "elu(x*w + b) =" << std::endl; print_rows(y, 5);
+
+    layer::dense<float>(x, packed, bias, y, layer::epilogue::mish<activation::accuracy::fast>{});
+    std::cout << "mish(x*w + b), fast =" << std::endl; print_rows(y, 5);
+
+    return 0;
+}
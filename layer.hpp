@@ -0,0 +1,297 @@
+#pragma once
+
+#include <concepts>
+
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+
+#include "activation.hpp"
+#include "loss.hpp"
+
+namespace layer {
+    // epilogues of the dense layer, applied to every output in the register
+    // tile before it is stored. they call the scalar activations with an
+    // approximate accuracy policy, so the epilogue vectorizes with the tile
+    namespace epilogue {
+        using activation::accuracy::ulp1;
+
+        struct none {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return z; }
+        };
+
+        struct relu {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::relu(z); }
+        };
+
+        struct prelu {
+            double alpha;
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::prelu(z, T(alpha)); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct sigmoid {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::sigmoid<T, Accuracy>(z); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct tanh {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::tanh<T, Accuracy>(z); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct elu {
+            double alpha;
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::elu<T, Accuracy>(z, T(alpha)); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct swish {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return z/(T{1} + activation::math::exp<Accuracy>(-z)); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct softplus {
+            double beta;
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::softplus<T, Accuracy>(z, T(beta)); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct mish {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::mish<T, Accuracy>(z); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct gelu {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::gelu<T, Accuracy>(z); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct gelu_tanh {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::gelu_tanh<T, Accuracy>(z); }
+        };
+
+        struct hard_swish {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::hard_swish(z); }
+        };
+
+        template <activation::accuracy::policy Accuracy = ulp1>
+        struct selu {
+            template <typename T>
+            constexpr T operator() (T const& z) const { return activation::selu<T, Accuracy>(z); }
+        };
+    }
+
+    template <std::floating_point T>
+    struct weights {
+        // a row-major [inputs, outputs] weight matrix packed once into panels
+        // of panel_cols columns, each panel contiguous over all the inputs and
+        // zero padded to full width. the gemm streams one panel per register
+        // tile instead of striding through the rows of the matrix
+        static constexpr std::size_t panel_cols = 64/sizeof(T)*2;
+
+        std::size_t inputs = 0;
+        std::size_t outputs = 0;
+        std::vector<T> panels;
+
+        weights () = default;
+
+        weights (loss::matrix_view<T const> w)
+            : inputs(w.rows), outputs(w.cols), panels(w.rows*((w.cols + panel_cols - 1)/panel_cols)*panel_cols, T{0}) {
+            for (std::size_t k = 0; k < inputs; ++k) {
+                for (std::size_t j = 0; j < outputs; ++j) {
+                    panels[panel(j/panel_cols) + k*panel_cols + j%panel_cols] = w.data[k*w.stride + j];
+                }
+            }
+        }
+
+        weights (std::span<T const> w, std::size_t outputs)
+            : weights(loss::matrix_view<T const>(w, outputs)) {}
+
+        std::size_t panel (std::size_t p) const {
+            // offset of the p-th panel
+            return p*inputs*panel_cols;
+        }
+    };
+
+    namespace gemm {
+        // y = f(x*w + bias) over register tiles of rows x panel_cols outputs.
+        // the tile accumulates over all the inputs at once, so the epilogue
+        // runs on finished sums and every output is stored exactly once
+
+        template <typename T>
+        struct vector {
+            // half a panel row. a gcc vector is one zmm, two ymm or four xmm
+            // depending on the target of the function using it
+            typedef T type __attribute__((vector_size(64)));
+            static constexpr std::size_t lanes = 64/sizeof(T);
+        };
+
+        template <std::size_t Rows, typename T, typename F>
+        [[gnu::always_inline]]
+        inline void tile (std::size_t rows, std::size_t cols, std::size_t inputs, T const* x, std::size_t x_stride,
+                          T const* panel, T const* bias, T* y, std::size_t y_stride, F const& f) {
+            using vec = typename vector<T>::type;
+            constexpr std::size_t lanes = vector<T>::lanes;
+            constexpr std::size_t width = weights<T>::panel_cols;
+            static_assert(width == 2*lanes);
+
+            T const* xr[Rows];
+            for (std::size_t i = 0; i < Rows; ++i) {
+                // rows past the end repeat the last one, their sums are dropped
+                xr[i] = x + std::min(i, rows - 1)*x_stride;
+            }
+
+            // Rows x 2 vector accumulators, written out so they stay in registers
+            vec acc[Rows][2] = {};
+            for (std::size_t k = 0; k < inputs; ++k) {
+                vec w0, w1;
+                std::memcpy(&w0, panel + k*width, sizeof(vec));
+                std::memcpy(&w1, panel + k*width + lanes, sizeof(vec));
+                #pragma GCC unroll 16
+                for (std::size_t i = 0; i < Rows; ++i) {
+                    T xi = xr[i][k];
+                    acc[i][0] += xi*w0;
+                    acc[i][1] += xi*w1;
+                }
+            }
+
+            // the epilogue on the finished sums, then the only store. f runs
+            // as one flat loop over the tile, long enough to vectorize well
+            vec b[2] = {};
+            std::memcpy(b, bias, cols*sizeof(T));
+            T out[Rows*width];
+            for (std::size_t i = 0; i < Rows; ++i) {
+                acc[i][0] += b[0];
+                acc[i][1] += b[1];
+            }
+            std::memcpy(out, acc, sizeof(out));
+            for (std::size_t j = 0; j < Rows*width; ++j) {
+                out[j] = f(out[j]);
+            }
+            for (std::size_t i = 0; i < std::min(rows, Rows); ++i) {
+                std::copy_n(out + i*width, cols, y + i*y_stride);
+            }
+        }
+
+        template <std::size_t Rows, typename T, typename F>
+        [[gnu::always_inline]]
+        inline void block (loss::matrix_view<T const> x, weights<T> const& w, T const* bias,
+                           loss::matrix_view<T> y, std::size_t row_lo, std::size_t row_hi,
+                           std::size_t panel_lo, std::size_t panel_hi, F const& f) {
+            // every panel once against all the rows of the block, which stay in cache
+            constexpr std::size_t width = weights<T>::panel_cols;
+            for (std::size_t p = panel_lo; p < panel_hi; ++p) {
+                std::size_t col = p*width;
+                std::size_t cols = std::min(width, w.outputs - col);
+                for (std::size_t r = row_lo; r < row_hi; r += Rows) {
+                    gemm::tile<Rows>(std::min(Rows, row_hi - r), cols, w.inputs, x.data + r*x.stride, x.stride,
+                                     w.panels.data() + w.panel(p), bias + col, y.data + r*y.stride + col, y.stride, f);
+                }
+            }
+        }
+
+        // the register tile height per instruction set, as many rows as
+        // leave the accumulators and a panel row in registers
+        template <typename T, typename F>
+        [[gnu::flatten, gnu::optimize("tree-vectorize")]]
+        static void block_generic (loss::matrix_view<T const> x, weights<T> const& w, T const* bias, loss::matrix_view<T> y,
+                                   std::size_t row_lo, std::size_t row_hi, std::size_t panel_lo, std::size_t panel_hi, F const& f) {
+            gemm::block<2>(x, w, bias, y, row_lo, row_hi, panel_lo, panel_hi, f);
+        }
+
+    #if defined(__x86_64__) || defined(__i386__)
+        template <typename T, typename F>
+        [[gnu::target("avx2,fma"), gnu::flatten, gnu::optimize("tree-vectorize")]]
+        static void block_avx2 (loss::matrix_view<T const> x, weights<T> const& w, T const* bias, loss::matrix_view<T> y,
+                                std::size_t row_lo, std::size_t row_hi, std::size_t panel_lo, std::size_t panel_hi, F const& f) {
+            gemm::block<3>(x, w, bias, y, row_lo, row_hi, panel_lo, panel_hi, f);
+        }
+
+        template <typename T, typename F>
+        [[gnu::target("avx512f,avx512dq"), gnu::flatten, gnu::optimize("tree-vectorize")]]
+        static void block_avx512 (loss::matrix_view<T const> x, weights<T> const& w, T const* bias, loss::matrix_view<T> y,
+                                  std::size_t row_lo, std::size_t row_hi, std::size_t panel_lo, std::size_t panel_hi, F const& f) {
+            gemm::block<6>(x, w, bias, y, row_lo, row_hi, panel_lo, panel_hi, f);
+        }
+    #endif
+
+        template <typename T, typename F>
+        static void run (loss::matrix_view<T const> x, weights<T> const& w, T const* bias, loss::matrix_view<T> y,
+                         std::size_t row_lo, std::size_t row_hi, std::size_t panel_lo, std::size_t panel_hi, F const& f) {
+            using activation::kernel::isa;
+            switch (activation::kernel::selected()) {
+            #if defined(__x86_64__) || defined(__i386__)
+                case isa::avx512: return block_avx512(x, w, bias, y, row_lo, row_hi, panel_lo, panel_hi, f);
+                case isa::avx2: return block_avx2(x, w, bias, y, row_lo, row_hi, panel_lo, panel_hi, f);
+            #endif
+                default: return block_generic(x, w, bias, y, row_lo, row_hi, panel_lo, panel_hi, f);
+            }
+        }
+    }
+
+    template <std::floating_point T, typename F = epilogue::none>
+    static void dense (loss::matrix_view<T const> x, weights<T> const& w, std::span<T const> bias, loss::matrix_view<T> y,
+                       F f = {}, loss::execution policy = loss::execution::parallel) {
+        // y = f(x*w + bias) for x [batch, inputs] and y [batch, outputs], e.g.
+        //   layer::dense(x, w, b, y, layer::epilogue::elu{0.1f})
+        // the rows are split into blocks whose x fits in l2 next to a panel,
+        // blocks and groups of panels are the tasks of the thread pool
+        assert(x.cols == w.inputs && y.rows == x.rows && y.cols == w.outputs);
+        assert(bias.empty() || bias.size() >= w.outputs);
+        if (x.rows == 0 || w.outputs == 0) {
+            return;
+        }
+
+        std::vector<T> zeros;
+        if (bias.empty()) {
+            zeros.assign(w.outputs, T{0});
+            bias = zeros;
+        }
+
+        constexpr std::size_t l2 = std::size_t{1} << 20;
+        constexpr std::size_t width = weights<T>::panel_cols;
+        std::size_t panels = (w.outputs + width - 1)/width;
+        std::size_t block_rows = std::clamp<std::size_t>(l2/(2*sizeof(T)*std::max<std::size_t>(w.inputs, 1)), 6, 256)/6*6;
+        std::size_t row_blocks = (x.rows + block_rows - 1)/block_rows;
+
+        // below about a million multiply-adds a thread costs more than it saves
+        double work = double(x.rows)*w.inputs*w.outputs;
+        std::size_t threads = policy == loss::execution::parallel && work >= 1e6 ? loss::parallel::default_pool().size() : 1;
+        std::size_t panel_groups = std::min(panels, (threads + row_blocks - 1)/row_blocks);
+        std::size_t tasks = row_blocks*panel_groups;
+
+        auto task = [&](std::size_t t) {
+            std::size_t rb = t/panel_groups, pg = t%panel_groups;
+            gemm::run(x, w, bias.data(), y, rb*block_rows, std::min(x.rows, (rb + 1)*block_rows),
+                      panels*pg/panel_groups, panels*(pg + 1)/panel_groups, f);
+        };
+        if (threads == 1 || tasks == 1) {
+            for (std::size_t t = 0; t < tasks; ++t) task(t);
+        } else {
+            loss::parallel::default_pool().run(tasks, task);
+        }
+    }
+
+    template <std::floating_point T, typename F = epilogue::none>
+    static void dense (std::span<T const> x, weights<T> const& w, std::span<T const> bias, std::span<T> y,
+                       F f = {}, loss::execution policy = loss::execution::parallel) {
+        // contiguous [batch, inputs] in, contiguous [batch, outputs] out
+        layer::dense<T>(loss::matrix_view<T const>(x, w.inputs), w, bias, loss::matrix_view<T>(y, w.outputs), f, policy);
+    }
+}
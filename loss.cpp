@@ -1,192 +1,7 @@
-#include <concepts>
 #include <iostream>
-
-#include <cmath>
-#include <ranges>
-#include <algorithm>
 #include <vector>
 
-namespace loss {
-
-    // anonimous namespace to hide apply_and_accumulate
-    namespace {
-        template <typename ...Ranges, std::invocable<typename Ranges::value_type...> F>
-        static constexpr decltype(auto) apply_and_accumulate (F f, Ranges const& ...rs) {
-            auto applied = std::views::zip_transform(f, rs...);
-            return std::ranges::fold_right(applied.begin(), applied.end(), 0, std::plus<>());
-        }
-    }
-
-    namespace distance {
-        template<typename T>
-        static constexpr T manhattan  (T t1, T t2) {
-            return std::abs(t1 - t2);
-        }
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T L1 (Range const& ground, Range const& predicted) {
-        T l1 = 0;
-        for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)){
-            l1 += std::abs(gnd - pred);
-        }
-        return l1;
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T L1_f (Range const& ground, Range const& predicted) {
-        return loss::apply_and_accumulate(loss::distance::manhattan<T>, ground, predicted);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T L2 (Range const& ground, Range const& predicted) {
-        T l2 = 0;
-        for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)){
-            l2 += std::pow(gnd - pred, 2);
-        }
-        return std::sqrt(l2);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T L2_f (Range const& ground, Range const& predicted) {
-        auto euc_dist = [](T a, T b) -> T { 
-            return std::pow(a - b, 2);
-        };
-        return std::sqrt(loss::apply_and_accumulate(euc_dist, ground, predicted));
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T huber (Range const& ground, Range const& predicted, T const threshold) {
-        T huber = 0;
-
-        auto hbr = [&threshold](T diff) -> T {
-            if (diff <= threshold) {
-                return std::pow(diff, 2)/2;
-            } else {
-                return threshold*std::abs(diff) - threshold/2;
-            }
-        };
-
-        for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)){
-            huber += hbr(gnd - pred);
-        }
-
-        return huber;
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T huber_f (Range const& ground, Range const& predicted, T const threshold) {
-        auto hbr = [&threshold](T a, T b) -> T {
-            T diff = a - b;
-            if (diff <= threshold) {
-                return std::pow(diff, 2)/2;
-            } else {
-                return threshold*std::abs(diff) - threshold/2;
-            }
-        };
-        return loss::apply_and_accumulate(hbr, ground, predicted);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T bce (Range const& ground, Range const& predicted) {
-        // binary_cross_entropy
-        T bce = 0;
-        for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)){
-            bce += gnd*std::log(pred) + (gnd - 1)*log(1 - pred);
-        }
-        return -bce/std::ranges::size(ground);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T bce_f (Range const& ground, Range const& predicted) {
-        // binary_cross_entropy
-        auto f = [](T gnd, T pred) -> T {
-            return gnd*std::log(pred) + (gnd - 1)*log(1 - pred);
-        };
-        T bce = loss::apply_and_accumulate(f, ground, predicted);
-        return -bce/std::ranges::size(ground);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T ce (Range const& ground, Range const& predicted) {
-        // cross_entropy
-        T ce = 0;
-        for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)){
-            ce += gnd*std::log(pred);
-        }
-        return -ce/std::ranges::size(ground);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T ce_f (Range const& ground, Range const& predicted) {
-        // cross_entropy
-        auto f = [](T gnd, T pred) -> T {
-            return gnd*std::log(pred);
-        };
-
-        
-        T ce = loss::apply_and_accumulate(f, ground, predicted);
-        return -ce/std::ranges::size(ground);
-    }
-
-    template <typename Range>
-    static constexpr Range softmax (Range const& predicted) {
-        using value_type_t = typename Range::value_type;
-        
-        // exponent all values
-        auto expd = predicted | std::views::transform(exp);
-        // sum of expd values
-        auto exp_sum = std::ranges::fold_right(expd.begin(), expd.end(), 0, std::plus<>());
-        
-        auto div_by_sum = [&exp_sum](auto pred) -> value_type_t {
-            return pred/exp_sum;
-        };
-
-        return expd | std::views::transform(div_by_sum) | std::ranges::to<Range>();
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T kl (Range const& ground, Range const& predicted) {
-        // KL divergence
-        auto f = [](T gnd, T pred) -> T {
-            return gnd*std::log(gnd/pred);
-        };
-
-        return loss::apply_and_accumulate(f, ground, predicted);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T contrastive (bool ground, Range const& featuresA, Range const& featuresB, T const margin) {
-        T dist = loss::L2_f(featuresA, featuresB);
-        using std::max, std::pow;
-
-        return [&]() -> T {
-            if (ground) {
-                return pow(dist, 2);
-            } else{
-                return pow(max(margin - dist, T{0}), 2);
-            }
-        }();
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T hinge (Range const& ground, Range const& predicted) {
-        auto f = [](T gnd, T pred) -> T {
-            return std::max(T{0}, T{1} - gnd*pred);
-        };
-
-        return loss::apply_and_accumulate(f, ground, predicted);
-    }
-
-    template <typename Range, typename T = typename Range::value_type>
-    static constexpr T tr (Range const& anchor, Range const& positive, Range const& negative, T const margin) {
-        // Triplet Ranking
-        T dist_pos = loss::L2_f(anchor, positive);
-        T dist_neg = loss::L2_f(anchor, negative);
-        
-        return std::max(dist_pos - dist_neg + margin, T{0});
-    }
-}
+#include "loss.hpp"
 
 int main () {
     std::vector<double> ground = {0.1, 1.0, 0.3, 0.5, 0.7};
@@ -211,10 +26,62 @@ int main () {
     std::cout << "CE = " << loss::ce(ground, predicted) << std::endl;
     std::cout << "CE_f = " << loss::ce_f(ground, predicted) << std::endl;
     std::cout << "softmax = "; print_range(loss::softmax(predicted));
+
+    // large ranges are folded in chunks on the thread pool
+    std::vector<double> big_ground(1 << 20, 0.25), big_predicted(1 << 20, 0.75);
+    std::cout << "L1_f parallel = " << loss::L1_f(big_ground, big_predicted, loss::execution::parallel) << std::endl;
+
+    // long float reductions drift with a naive sum, 2^24 terms of 0.1 sum to 1677721.6
+    std::vector<float> small_ground(1 << 24, 0.0f), small_predicted(1 << 24, 0.1f);
+    std::cout << "L1 float naive = " << loss::L1(small_ground, small_predicted)
+              << ", pairwise = " << loss::L1<loss::summation::pairwise>(small_ground, small_predicted)
+              << ", kahan = " << loss::L1<loss::summation::kahan>(small_ground, small_predicted)
+              << ", double accumulator = " << loss::L1<loss::summation::mixed<double>>(small_ground, small_predicted) << std::endl;
+
+    // [2, 3] logits, the second row would overflow a naive exp
+    std::vector<double> logits = {1.0, 2.0, 3.0, 1000.0, 1001.0, 1002.0};
+    std::vector<double> probabilities(logits.size());
+    loss::softmax<double>(logits, probabilities, 3);
+    std::cout << "batched softmax = "; print_range(probabilities);
+
+    std::vector<double> targets = {0.0, 0.0, 1.0, 0.0, 1.0, 0.0};
+    std::vector<std::size_t> labels = {2, 1};
+    std::cout << "CE from logits = " << loss::ce_from_logits<double>(targets, logits, 3) << std::endl;
+    std::cout << "sparse CE from logits = " << loss::sparse_ce_from_logits<double>(labels, logits) << std::endl;
     std::cout << "KL = " << loss::kl(ground, predicted) << std::endl;
     std::cout << "contrastive = " << loss::contrastive(1, ground, predicted, 2.0) << std::endl;
     std::cout << "hinge = " << loss::hinge(ground, predicted) << std::endl;
     std::cout << "Triplet Ranking = " << loss::tr(predicted, ground, predicted, 0.2) << std::endl;
+
+    std::vector<double> grad(predicted.size());
+    std::cout << "L2 value_and_grad = " << loss::L2_value_and_grad(ground, predicted, grad) << ", grad = "; print_range(grad);
+    std::cout << "BCE value_and_grad = " << loss::bce_value_and_grad(ground, predicted, grad) << ", grad = "; print_range(grad);
+    loss::huber_grad(ground, predicted, grad, 0.2);
+    std::cout << "Huber grad = "; print_range(grad);
+
+    // logits far past where sigmoid saturates in floating point
+    std::vector<double> bce_logits = {-2.0, 40.0, 0.5, -40.0, 3.0};
+    std::cout << "BCE with logits value_and_grad = " << loss::bce_with_logits_value_and_grad<double>(ground, bce_logits, grad) << ", grad = "; print_range(grad);
+
+    // elementwise terms and a weighted mean in the same kernel
+    std::vector<double> elementwise(predicted.size());
+    loss::bce(ground, predicted, loss::reduction<double>::none(elementwise));
+    std::cout << "BCE elementwise = "; print_range(elementwise);
+    std::vector<double> weights = {1.0, 2.0, 1.0, 0.5, 0.5};
+    std::cout << "BCE weighted mean = " << loss::bce(ground, predicted, loss::reduction<double>::mean(weights)) << std::endl;
+    std::vector<double> class_weights = {1.0, 1.0, 4.0};
+    std::cout << "sparse CE from logits, class weighted = "
+              << loss::sparse_ce_from_logits<double>(labels, logits, loss::reduction<double>::mean(class_weights, 3)) << std::endl;
+
+    // [2, 3] minibatch, one L1 per row and the batch mean
+    std::vector<double> batch_ground = {0.0, 1.0, 2.0, 1.0, 1.0, 1.0};
+    std::vector<double> batch_predicted = {0.5, 1.0, 1.0, 1.0, 3.0, 1.0};
+    loss::matrix_view<double const> batch_g(batch_ground, 3), batch_p(batch_predicted, 3);
+    auto row_l1 = [](auto g, auto p){ return loss::L1(g, p); };
+    std::vector<double> per_sample(batch_g.rows);
+    loss::batched::per_sample(row_l1, batch_g, batch_p, per_sample);
+    std::cout << "batched L1 = "; print_range(per_sample);
+    std::cout << "batched L1 mean = " << loss::batched::mean(row_l1, batch_g, batch_p, loss::execution::parallel) << std::endl;
     
     return 0;
 }
@@ -0,0 +1,1304 @@
+#pragma once
+
+#include <concepts>
+
+#include <cmath>
+#include <ranges>
+#include <algorithm>
+#include <vector>
+#include <span>
+#include <limits>
+#include <cassert>
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include <type_traits>
+#include <version>
+#ifdef __cpp_lib_mdspan
+#include <mdspan>
+#endif
+
+#include "activation.hpp"
+
+namespace loss {
+
+    namespace parallel {
+        // fixed set of workers executing one fork-join job at a time. the
+        // calling thread takes part in the job, so a pool of size n owns
+        // n - 1 threads
+        class thread_pool {
+        public:
+            explicit thread_pool (std::size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+                for (std::size_t t = 1; t < threads; ++t) {
+                    workers.emplace_back([this]{ work(); });
+                }
+            }
+
+            thread_pool (thread_pool const&) = delete;
+            thread_pool& operator= (thread_pool const&) = delete;
+
+            ~thread_pool () {
+                {
+                    std::lock_guard lock(m);
+                    stopping = true;
+                }
+                wake.notify_all();
+            }
+
+            std::size_t size () const {
+                return workers.size() + 1;
+            }
+
+            // calls f(task) for every task in [0, tasks) and returns once
+            // all of them are done. calls from inside a task run inline,
+            // on the workers and on the thread that submitted the job. if a
+            // task throws, the tasks not yet started are skipped and the
+            // first exception is rethrown here
+            template <std::invocable<std::size_t> F>
+            void run (std::size_t tasks, F&& f) {
+                if (tasks < 2 || workers.empty() || in_job()) {
+                    for (std::size_t task = 0; task < tasks; ++task) {
+                        f(task);
+                    }
+                    return;
+                }
+
+                in_job() = true;
+                struct leave { ~leave () { in_job() = false; } } left;
+                std::lock_guard serial(submit);
+                {
+                    // workers late from the previous job leave before the
+                    // new one is published, so job and job_tasks stay put
+                    // while anyone executes
+                    std::unique_lock lock(m);
+                    finished.wait(lock, [&]{ return active == 0; });
+                    job = [&f](std::size_t task){ f(task); };
+                    job_tasks = tasks;
+                    next = 0;
+                    done = 0;
+                    failed = false;
+                    ++generation;
+                }
+                wake.notify_all();
+
+                execute();
+
+                std::unique_lock lock(m);
+                finished.wait(lock, [&]{ return done == job_tasks; });
+                if (error) {
+                    std::rethrow_exception(std::exchange(error, nullptr));
+                }
+            }
+
+        private:
+            static bool& in_job () {
+                // one flag per thread for every pool, a member function
+                // defined in the class is inline so there's one definition
+                thread_local bool flag = false;
+                return flag;
+            }
+
+            void execute () {
+                for (std::size_t task; (task = next.fetch_add(1)) < job_tasks; ) {
+                    // a failed job still counts every task so run can return
+                    if (!failed) {
+                        try {
+                            job(task);
+                        } catch (...) {
+                            std::lock_guard lock(m);
+                            if (!error) {
+                                error = std::current_exception();
+                            }
+                            failed = true;
+                        }
+                    }
+                    if (done.fetch_add(1) + 1 == job_tasks) {
+                        std::lock_guard lock(m);
+                        finished.notify_all();
+                    }
+                }
+            }
+
+            void work () {
+                in_job() = true;
+                std::size_t seen = 0;
+                for (;;) {
+                    {
+                        std::unique_lock lock(m);
+                        wake.wait(lock, [&]{ return stopping || generation != seen; });
+                        if (stopping) {
+                            return;
+                        }
+                        seen = generation;
+                        ++active;
+                    }
+                    execute();
+                    {
+                        std::lock_guard lock(m);
+                        if (--active == 0) {
+                            finished.notify_all();
+                        }
+                    }
+                }
+            }
+
+            std::mutex m, submit;
+            std::condition_variable wake, finished;
+            std::function<void (std::size_t)> job;
+            std::size_t job_tasks = 0, generation = 0, active = 0;
+            std::atomic<std::size_t> next{0}, done{0};
+            std::atomic<bool> failed{false};
+            std::exception_ptr error;
+            bool stopping = false;
+            std::vector<std::jthread> workers;
+        };
+
+        inline thread_pool& default_pool () {
+            // inline, one pool for the whole program rather than per
+            // translation unit
+            static thread_pool pool;
+            return pool;
+        }
+    }
+
+    enum class execution { sequential, parallel };
+
+    namespace summation {
+        // summation policies, each provides an accumulator<T> with +=, a
+        // rescale *= and value(). losses take one as their first template
+        // parameter, e.g. loss::L1<loss::summation::kahan>(ground, predicted)
+
+        // plain running sum, error grows linearly with the number of terms
+        struct naive {
+            template <typename T>
+            struct accumulator {
+                T sum{0};
+
+                constexpr void operator+= (T x) {
+                    sum += x;
+                }
+
+                constexpr void operator*= (T s) {
+                    sum *= s;
+                }
+
+                constexpr T value () const {
+                    return sum;
+                }
+            };
+        };
+
+        // Neumaier's variant of Kahan summation, the exact rounding error of
+        // every add is recovered, also when the new term is larger than the
+        // running sum. the errors themselves are summed with Kahan's feedback
+        // so the compensation can't drift over long float reductions
+        struct kahan {
+            template <typename T>
+            struct accumulator {
+                T sum{0};
+                T compensation{0};
+                T carry{0};
+
+                constexpr void operator+= (T x) {
+                    using std::abs;
+                    T t = sum + x;
+                    T error = activation::select(abs(sum) >= abs(x), (sum - t) + x, (x - t) + sum);
+                    sum = t;
+
+                    T y = error - carry;
+                    T c = compensation + y;
+                    carry = (c - compensation) - y;
+                    compensation = c;
+                }
+
+                constexpr void operator*= (T s) {
+                    sum *= s;
+                    compensation *= s;
+                    carry *= s;
+                }
+
+                constexpr T value () const {
+                    return sum + compensation;
+                }
+            };
+        };
+
+        // streaming pairwise (cascade) summation. blocks of terms are summed
+        // naively and block sums merged like a binary counter, level k holds
+        // the sum of 2^k blocks, so the error grows with log(n)
+        struct pairwise {
+            template <typename T>
+            struct accumulator {
+                static constexpr std::size_t block = 32;
+
+                T partial{0};
+                std::size_t count = 0;
+                std::array<T, 64> levels{};
+                std::uint64_t occupied = 0;
+
+                constexpr void operator+= (T x) {
+                    partial += x;
+                    if (++count == block) {
+                        carry(partial);
+                        partial = 0;
+                        count = 0;
+                    }
+                }
+
+                constexpr void operator*= (T s) {
+                    partial *= s;
+                    for (T& level : levels) {
+                        level *= s;
+                    }
+                }
+
+                constexpr T value () const {
+                    // smallest levels first
+                    T sum = partial;
+                    for (std::size_t k = 0; k < levels.size(); ++k) {
+                        if (occupied >> k & 1) {
+                            sum += levels[k];
+                        }
+                    }
+                    return sum;
+                }
+
+            private:
+                constexpr void carry (T s) {
+                    std::size_t k = 0;
+                    for (; occupied >> k & 1; ++k) {
+                        s += levels[k];
+                        occupied &= ~(std::uint64_t{1} << k);
+                    }
+                    levels[k] = s;
+                    occupied |= std::uint64_t{1} << k;
+                }
+            };
+        };
+
+        // one of the above accumulating in Acc whatever the element type,
+        // loss::L1<loss::summation::mixed<double>>(ground, predicted) sums
+        // float data in double and returns a double. terms are computed in
+        // the element type and widened as they're added. over a naive sum
+        // and sized random access ranges the losses add them into 16 lanes,
+        // so the converts and the adds vectorize, other policies and ranges
+        // stay serial
+        template <typename Acc, typename Sum = naive>
+        struct mixed {
+            using accumulation = Acc;
+
+            template <typename T>
+            using accumulator = typename Sum::template accumulator<Acc>;
+        };
+
+        template <typename Sum, typename T>
+        using accumulator_t = typename Sum::template accumulator<T>;
+
+        // the type a loss over elements of type T accumulates and returns
+        template <typename Sum, typename T>
+        struct accumulation {
+            using type = T;
+        };
+
+        template <typename Sum, typename T>
+        requires requires { typename Sum::accumulation; }
+        struct accumulation<Sum, T> {
+            using type = typename Sum::accumulation;
+        };
+
+        template <typename Sum, typename T>
+        using accumulation_t = typename accumulation<Sum, T>::type;
+
+        // policies whose order of adds is free, the lanes of activation::kernel::sum
+        template <typename Sum>
+        inline constexpr bool lanewise = false;
+
+        template <typename Acc>
+        inline constexpr bool lanewise<mixed<Acc, naive>> = true;
+    }
+
+    template <typename Sum>
+    concept summation_policy = requires (summation::accumulator_t<Sum, double> acc) {
+        acc += 1.0;
+        acc *= 1.0;
+        { acc.value() } -> std::convertible_to<double>;
+    };
+
+    template <summation_policy Sum, typename T, typename F>
+    requires std::invocable<F, std::size_t>
+    static constexpr T accumulate (std::size_t n, F term) {
+        // term(0) + ... + term(n - 1) accumulated in T as Sum does, over the
+        // lanes of activation::kernel::sum when Sum is lanewise
+        if constexpr (summation::lanewise<Sum>) {
+            if (!std::is_constant_evaluated()) {
+                return activation::kernel::sum<T>(n, term);
+            }
+        }
+        summation::accumulator_t<Sum, T> acc;
+        for (std::size_t i = 0; i < n; ++i) {
+            acc += term(i);
+        }
+        return acc.value();
+    }
+
+    template <summation_policy Sum, typename T, typename F, typename Range>
+    static constexpr T accumulate (F f, Range const& ground, Range const& predicted) {
+        // f(gnd, pred) over the zipped ranges accumulated in T. sized random
+        // access ranges are indexed through accumulate(n, term) and its
+        // lanes, any other range is walked by the zip
+        if constexpr (std::ranges::random_access_range<Range const> && std::ranges::sized_range<Range const>) {
+            auto gnd = std::ranges::begin(ground);
+            auto pred = std::ranges::begin(predicted);
+            std::size_t n = std::min<std::size_t>(std::ranges::size(ground), std::ranges::size(predicted));
+            return loss::accumulate<Sum, T>(n, [=](std::size_t i) { return f(gnd[i], pred[i]); });
+        } else {
+            summation::accumulator_t<Sum, T> acc;
+            for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)) {
+                acc += f(gnd, pred);
+            }
+            return acc.value();
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename F, std::ranges::random_access_range ...Ranges>
+    requires std::invocable<F, std::ranges::range_value_t<Ranges>...>
+    static constexpr auto apply_and_accumulate (F f, Ranges const& ...rs) {
+        // left fold of f over the zipped ranges, accumulated in the type f
+        // returns. four independent accumulators break the dependency chain
+        // on the adds so consecutive elements overlap in the pipeline
+        using T = std::remove_cvref_t<std::invoke_result_t<F, std::ranges::range_value_t<Ranges>...>>;
+        std::size_t n = std::min({static_cast<std::size_t>(std::ranges::size(rs))...});
+
+        summation::accumulator_t<Sum, T> acc0, acc1, acc2, acc3;
+        std::size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            acc0 += f(std::ranges::begin(rs)[i]...);
+            acc1 += f(std::ranges::begin(rs)[i + 1]...);
+            acc2 += f(std::ranges::begin(rs)[i + 2]...);
+            acc3 += f(std::ranges::begin(rs)[i + 3]...);
+        }
+        for (; i < n; ++i) {
+            acc0 += f(std::ranges::begin(rs)[i]...);
+        }
+        acc0 += acc1.value();
+        acc2 += acc3.value();
+        acc0 += acc2.value();
+        return acc0.value();
+    }
+
+    template <summation_policy Sum = summation::naive, typename F, std::ranges::random_access_range ...Ranges>
+    requires std::invocable<F, std::ranges::range_value_t<Ranges>...>
+    static constexpr auto apply_and_accumulate (execution policy, F f, Ranges const& ...rs) {
+        // parallel mode splits the ranges into contiguous chunks of at least
+        // grain elements, folds each on the default pool and adds the partial
+        // sums in chunk order, so the result doesn't depend on scheduling
+        using T = std::remove_cvref_t<std::invoke_result_t<F, std::ranges::range_value_t<Ranges>...>>;
+        constexpr std::size_t grain = std::size_t{1} << 16;
+        std::size_t n = std::min({static_cast<std::size_t>(std::ranges::size(rs))...});
+
+        if (std::is_constant_evaluated() || policy == execution::sequential || n < 2*grain) {
+            return loss::apply_and_accumulate<Sum>(f, rs...);
+        }
+
+        auto& pool = parallel::default_pool();
+        std::size_t chunks = std::min(n/grain, 4*pool.size());
+        std::vector<T> partial(chunks);
+        pool.run(chunks, [&](std::size_t chunk) {
+            std::size_t lo = n*chunk/chunks, hi = n*(chunk + 1)/chunks;
+            partial[chunk] = loss::apply_and_accumulate<Sum>(f,
+                std::ranges::subrange(std::ranges::begin(rs) + lo, std::ranges::begin(rs) + hi)...);
+        });
+
+        summation::accumulator_t<Sum, T> acc;
+        for (T p : partial) {
+            acc += p;
+        }
+        return acc.value();
+    }
+
+    enum class reduction_mode { none, sum, mean };
+
+    template <typename T>
+    struct reduction {
+        // how a loss reduces its elementwise terms. none writes them to out,
+        // sum and mean fold them. with weights every term is scaled by its
+        // weight and mean divides by the total weight instead of the count.
+        // weights hold one value per element, or one per class when classes
+        // is set and the data is a row-major [batch, classes] matrix
+        reduction_mode mode = reduction_mode::mean;
+        std::span<T> out = {};
+        std::span<T const> weights = {};
+        std::size_t classes = 0;
+
+        static constexpr reduction none (std::span<T> out, std::span<T const> weights = {}, std::size_t classes = 0) {
+            return {reduction_mode::none, out, weights, classes};
+        }
+
+        static constexpr reduction sum (std::span<T const> weights = {}, std::size_t classes = 0) {
+            return {reduction_mode::sum, {}, weights, classes};
+        }
+
+        static constexpr reduction mean (std::span<T const> weights = {}, std::size_t classes = 0) {
+            return {reduction_mode::mean, {}, weights, classes};
+        }
+    };
+
+    template <summation_policy Sum = summation::naive, typename T, typename F>
+    requires std::invocable<F, std::size_t>
+    static constexpr T reduce (std::size_t n, F term, reduction<T> const& r) {
+        // applies r to the n terms term(i) in a single pass. none returns 0
+        bool weighted = !r.weights.empty();
+        assert(!weighted || r.weights.size() >= (r.classes ? r.classes : n));
+        assert(r.mode != reduction_mode::none || r.out.size() >= n);
+
+        // g(i, weight) over all terms, per-class weights walk the rows so
+        // the weight index needs no division
+        auto each = [&](auto&& g) {
+            if (!weighted) {
+                for (std::size_t i = 0; i < n; ++i) {
+                    g(i, T{1});
+                }
+                return;
+            }
+            std::size_t cols = r.classes ? r.classes : n;
+            std::size_t weight_stride = r.classes ? 0 : cols;
+            for (std::size_t base = 0, row = 0; base < n; base += cols, ++row) {
+                T const* w = r.weights.data() + row*weight_stride;
+                std::size_t last = std::min(cols, n - base);
+                for (std::size_t c = 0; c < last; ++c) {
+                    g(base + c, w[c]);
+                }
+            }
+        };
+
+        if (r.mode == reduction_mode::none) {
+            each([&](std::size_t i, T w) {
+                r.out[i] = w*term(i);
+            });
+            return T{0};
+        }
+
+        summation::accumulator_t<Sum, T> total, mass;
+        each([&](std::size_t i, T w) {
+            total += w*term(i);
+            if (weighted) {
+                mass += w;
+            }
+        });
+
+        if (r.mode == reduction_mode::sum) {
+            return total.value();
+        }
+        return total.value()/(weighted ? mass.value() : T(n));
+    }
+
+    namespace distance {
+        // written with adl calls and activation::select so T may be a simd
+        // pack as well, the _f losses over ranges of packs then fold every
+        // lane at once
+        template<typename T>
+        static constexpr T manhattan  (T t1, T t2) {
+            using std::abs;
+            return abs(t1 - t2);
+        }
+
+        template<typename T>
+        static constexpr T squared_euclidean (T t1, T t2) {
+            T diff = t1 - t2;
+            return diff*diff;
+        }
+
+        template<typename T>
+        static constexpr T huber (T t1, T t2, T threshold) {
+            using std::abs;
+            T diff = abs(t1 - t2);
+            return activation::select(diff <= threshold, diff*diff/2, threshold*diff - threshold*threshold/2);
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L1 (Range const& ground, Range const& predicted) {
+        return loss::accumulate<Sum, T>([](auto gnd, auto pred) { return std::abs(gnd - pred); }, ground, predicted);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L1 (Range const& ground, Range const& predicted, reduction<T> const& r) {
+        // the sum reduction equals L1(ground, predicted)
+        assert(std::ranges::size(ground) == std::ranges::size(predicted));
+        auto gnd = std::ranges::begin(ground);
+        auto pred = std::ranges::begin(predicted);
+        return loss::reduce<Sum>(std::ranges::size(predicted), [&](std::size_t i) -> T {
+            return std::abs(gnd[i] - pred[i]);
+        }, r);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L1_f (Range const& ground, Range const& predicted, execution policy = execution::sequential) {
+        return loss::apply_and_accumulate<Sum>(policy, loss::distance::manhattan<T>, ground, predicted);
+    }
+
+    template <typename Range, typename T = typename Range::value_type>
+    static constexpr void L1_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // d/dpred |gnd - pred| = sign(pred - gnd)
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            g = T(pred > gnd) - T(pred < gnd);
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L1_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        summation::accumulator_t<Sum, T> l1;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            l1 += std::abs(gnd - pred);
+            g = T(pred > gnd) - T(pred < gnd);
+        }
+        return l1.value();
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L2 (Range const& ground, Range const& predicted) {
+        return std::sqrt(loss::accumulate<Sum, T>([](auto gnd, auto pred) { return (gnd - pred)*(gnd - pred); }, ground, predicted));
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L2_f (Range const& ground, Range const& predicted, execution policy = execution::sequential) {
+        using std::sqrt;
+        return sqrt(loss::apply_and_accumulate<Sum>(policy, loss::distance::squared_euclidean<T>, ground, predicted));
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T L2_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // d/dpred L2 = (pred - gnd)/L2, the differences are kept in grad
+        // while the norm accumulates and scaled afterwards
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        summation::accumulator_t<Sum, T> squares;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            g = pred - gnd;
+            squares += g*g;
+        }
+        T l2 = std::sqrt(squares.value());
+
+        T inv_l2 = l2 > T{0} ? T{1}/l2 : T{0};
+        for (T& g : grad.first(std::ranges::size(predicted))) {
+            g *= inv_l2;
+        }
+        return l2;
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr void L2_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // the gradient needs the norm anyway
+        loss::L2_value_and_grad<Sum>(ground, predicted, grad);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T huber (Range const& ground, Range const& predicted, T const threshold) {
+        summation::accumulator_t<Sum, T> huber;
+
+        for (auto&& [gnd, pred] : std::ranges::views::zip(ground, predicted)){
+            huber += loss::distance::huber<T>(gnd, pred, threshold);
+        }
+
+        return huber.value();
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T huber (Range const& ground, Range const& predicted, T const threshold, reduction<T> const& r) {
+        // the sum reduction equals huber(ground, predicted, threshold)
+        assert(std::ranges::size(ground) == std::ranges::size(predicted));
+        auto gnd = std::ranges::begin(ground);
+        auto pred = std::ranges::begin(predicted);
+        return loss::reduce<Sum>(std::ranges::size(predicted), [&](std::size_t i) -> T {
+            T diff = gnd[i] - pred[i];
+            T abs_diff = std::abs(diff);
+            return abs_diff <= threshold ? diff*diff/2 : threshold*abs_diff - threshold*threshold/2;
+        }, r);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T huber_f (Range const& ground, Range const& predicted, T const threshold, execution policy = execution::sequential) {
+        auto hbr = [threshold](T a, T b) -> T {
+            return loss::distance::huber(a, b, threshold);
+        };
+        return loss::apply_and_accumulate<Sum>(policy, hbr, ground, predicted);
+    }
+
+    template <typename Range, typename T = typename Range::value_type>
+    static constexpr void huber_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad, T const threshold) {
+        // pred - gnd inside the threshold, threshold*sign(pred - gnd) outside
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            T diff = pred - gnd;
+            g = std::abs(diff) <= threshold ? diff : std::copysign(threshold, diff);
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T huber_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad, T const threshold) {
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        summation::accumulator_t<Sum, T> huber;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            T diff = pred - gnd;
+            if (std::abs(diff) <= threshold) {
+                huber += diff*diff/2;
+                g = diff;
+            } else {
+                huber += threshold*std::abs(diff) - threshold*threshold/2;
+                g = std::copysign(threshold, diff);
+            }
+        }
+        return huber.value();
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T bce (Range const& ground, Range const& predicted) {
+        // binary_cross_entropy
+        T bce = loss::accumulate<Sum, T>([](auto gnd, auto pred) {
+            return gnd*std::log(pred) + (1 - gnd)*std::log(1 - pred);
+        }, ground, predicted);
+        return -bce/std::ranges::size(ground);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T bce (Range const& ground, Range const& predicted, reduction<T> const& r) {
+        // the mean reduction equals bce(ground, predicted)
+        assert(std::ranges::size(ground) == std::ranges::size(predicted));
+        auto gnd = std::ranges::begin(ground);
+        auto pred = std::ranges::begin(predicted);
+        return loss::reduce<Sum>(std::ranges::size(predicted), [&](std::size_t i) -> T {
+            return -(gnd[i]*std::log(pred[i]) + (1 - gnd[i])*std::log(1 - pred[i]));
+        }, r);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T bce_f (Range const& ground, Range const& predicted, execution policy = execution::sequential) {
+        // binary_cross_entropy
+        auto f = [](T gnd, T pred) -> T {
+            using std::log;
+            return gnd*log(pred) + (1 - gnd)*log(1 - pred);
+        };
+        T bce = loss::apply_and_accumulate<Sum>(policy, f, ground, predicted);
+        return -bce/std::ranges::size(ground);
+    }
+
+    template <typename Range, typename T = typename Range::value_type>
+    static constexpr void bce_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // d/dpred bce = (pred - gnd)/(pred*(1 - pred))/n
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        T n = std::ranges::size(ground);
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            g = (pred - gnd)/(pred*(1 - pred)*n);
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T bce_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        T n = std::ranges::size(ground);
+        summation::accumulator_t<Sum, T> bce;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            bce += gnd*std::log(pred) + (1 - gnd)*std::log(1 - pred);
+            g = (pred - gnd)/(pred*(1 - pred)*n);
+        }
+        return -bce.value()/n;
+    }
+
+    namespace {
+        template <std::floating_point T>
+        static constexpr std::pair<T, T> bce_logit (T const& gnd, T const& z) {
+            // bce of sigmoid(z) as max(z, 0) - gnd*z + log1p(exp(-|z|)) and
+            // sigmoid(z) itself, both from the single exp(-|z|). the select
+            // picks the numerator ahead of the division so the loop stays
+            // branch-free
+            using activation::math::exp, activation::math::log1p;
+            T e = exp(z < T{0} ? z : -z);
+            T value = (z > T{0} ? z : T{0}) - gnd*z + log1p(e);
+            T sigmoid = (z < T{0} ? e : T{1})/(T{1} + e);
+            return {value, sigmoid};
+        }
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static T bce_with_logits (std::span<T const> ground, std::span<T const> logits) {
+        // bce(ground, sigmoid(logits)) without the probabilities, one exp and
+        // one log1p per element and finite for any finite logit. the terms
+        // are computed vectorized a block at a time and summed by the policy
+        assert(ground.size() == logits.size());
+        constexpr std::size_t block = 256;
+        std::array<T, block> terms;
+        summation::accumulator_t<Sum, T> bce;
+        for (std::size_t first = 0; first < logits.size(); first += block) {
+            std::size_t n = std::min(block, logits.size() - first);
+            T const* g = ground.data() + first;
+            T const* z = logits.data() + first;
+            T* t = terms.data();
+            activation::kernel::loop(n, [=](std::size_t i) { t[i] = bce_logit(g[i], z[i]).first; });
+            bce += loss::apply_and_accumulate<Sum>([](T term) { return term; }, std::span<T const>(t, n));
+        }
+        return bce.value()/logits.size();
+    }
+
+    template <std::floating_point T>
+    static void bce_with_logits_grad (std::span<T const> ground, std::span<T const> logits, std::span<T> grad) {
+        // d/dz bce = (sigmoid(z) - gnd)/n
+        assert(ground.size() == logits.size() && grad.size() >= logits.size());
+        T const* g = ground.data();
+        T const* z = logits.data();
+        T* d = grad.data();
+        T inv_n = T{1}/logits.size();
+        activation::kernel::loop(logits.size(), [=](std::size_t i) {
+            d[i] = (bce_logit(g[i], z[i]).second - g[i])*inv_n;
+        });
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static T bce_with_logits_value_and_grad (std::span<T const> ground, std::span<T const> logits, std::span<T> grad) {
+        // the terms go through grad, which is then overwritten with the
+        // gradient of its block while still in cache
+        assert(ground.size() == logits.size() && grad.size() >= logits.size());
+        constexpr std::size_t block = 256;
+        std::array<T, block> sigmoids;
+        summation::accumulator_t<Sum, T> bce;
+        T inv_n = T{1}/logits.size();
+        for (std::size_t first = 0; first < logits.size(); first += block) {
+            std::size_t n = std::min(block, logits.size() - first);
+            T const* g = ground.data() + first;
+            T const* z = logits.data() + first;
+            T* d = grad.data() + first;
+            T* s = sigmoids.data();
+            activation::kernel::loop(n, [=](std::size_t i) {
+                auto [value, sigmoid] = bce_logit(g[i], z[i]);
+                d[i] = value;
+                s[i] = sigmoid;
+            });
+            bce += loss::apply_and_accumulate<Sum>([](T term) { return term; }, std::span<T const>(d, n));
+            activation::kernel::loop(n, [=](std::size_t i) { d[i] = (s[i] - g[i])*inv_n; });
+        }
+        return bce.value()*inv_n;
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr T bce_with_logits (std::span<T const> ground, std::span<T const> logits, reduction<T> const& r) {
+        // elementwise bce_with_logits reduced by r, the mean reduction
+        // equals bce_with_logits(ground, logits)
+        assert(ground.size() == logits.size());
+        return loss::reduce<Sum>(logits.size(), [&](std::size_t i) -> T {
+            return bce_logit(ground[i], logits[i]).first;
+        }, r);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T ce (Range const& ground, Range const& predicted) {
+        // cross_entropy
+        T ce = loss::accumulate<Sum, T>([](auto gnd, auto pred) { return gnd*std::log(pred); }, ground, predicted);
+        return -ce/std::ranges::size(ground);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T ce (Range const& ground, Range const& predicted, reduction<T> const& r) {
+        // the mean reduction equals ce(ground, predicted)
+        assert(std::ranges::size(ground) == std::ranges::size(predicted));
+        auto gnd = std::ranges::begin(ground);
+        auto pred = std::ranges::begin(predicted);
+        return loss::reduce<Sum>(std::ranges::size(predicted), [&](std::size_t i) -> T {
+            return -gnd[i]*std::log(pred[i]);
+        }, r);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T ce_f (Range const& ground, Range const& predicted, execution policy = execution::sequential) {
+        // cross_entropy
+        auto f = [](T gnd, T pred) -> T {
+            using std::log;
+            return gnd*log(pred);
+        };
+
+        
+        T ce = loss::apply_and_accumulate<Sum>(policy, f, ground, predicted);
+        return -ce/std::ranges::size(ground);
+    }
+
+    template <typename Range, typename T = typename Range::value_type>
+    static constexpr void ce_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // d/dpred ce = -gnd/(pred*n)
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        T n = std::ranges::size(ground);
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            g = -gnd/(pred*n);
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T ce_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        T n = std::ranges::size(ground);
+        summation::accumulator_t<Sum, T> ce;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            ce += gnd*std::log(pred);
+            g = -gnd/(pred*n);
+        }
+        return -ce.value()/n;
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr void softmax (std::span<T const> logits, std::span<T> out) {
+        // numerically stable softmax into a caller-provided buffer,
+        // out may be the same buffer as logits.
+        // max pass, then exp(z - max) is stored and summed in one pass
+        // and finally scaled, so exp runs once per element and can't overflow
+        assert(out.size() >= logits.size());
+        if (logits.empty()) {
+            return;
+        }
+
+        T max = logits[0];
+        for (T z : logits) {
+            max = z > max ? z : max;
+        }
+
+        summation::accumulator_t<Sum, T> exp_sum;
+        for (std::size_t i = 0; i < logits.size(); ++i) {
+            out[i] = std::exp(logits[i] - max);
+            exp_sum += out[i];
+        }
+
+        T inv_sum = T{1}/exp_sum.value();
+        for (std::size_t i = 0; i < logits.size(); ++i) {
+            out[i] *= inv_sum;
+        }
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr void softmax (std::span<T const> logits, std::span<T> out, std::size_t classes) {
+        // row-wise softmax of a row-major [batch, classes] matrix
+        assert(classes > 0 && logits.size() % classes == 0);
+        assert(out.size() >= logits.size());
+        for (std::size_t row = 0; row < logits.size(); row += classes) {
+            loss::softmax<T, Sum>(logits.subspan(row, classes), out.subspan(row, classes));
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range>
+    static constexpr Range softmax (Range const& predicted) {
+        using value_type_t = typename Range::value_type;
+
+        Range probabilities(std::ranges::size(predicted));
+        loss::softmax<value_type_t, Sum>(predicted, probabilities);
+        return probabilities;
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static T logsumexp (std::span<T const> logits) {
+        // log(sum(exp(z))) as max + log(sum(exp(z - max))). a max pass, then
+        // the exps are computed vectorized a block at a time and summed by
+        // the policy
+        T const* x = logits.data();
+        T max = activation::kernel::max<T>(logits.size(), [=](std::size_t i) { return x[i]; });
+
+        constexpr std::size_t block = 256;
+        std::array<T, block> exps;
+        summation::accumulator_t<Sum, T> exp_sum;
+        for (std::size_t first = 0; first < logits.size(); first += block) {
+            std::size_t n = std::min(block, logits.size() - first);
+            T const* z = logits.data() + first;
+            T* e = exps.data();
+            activation::kernel::loop(n, [=](std::size_t i) { e[i] = activation::math::exp(z[i] - max); });
+            exp_sum += loss::apply_and_accumulate<Sum>([](T term) { return term; }, std::span<T const>(e, n));
+        }
+        return max + std::log(exp_sum.value());
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static T ce_from_logits (std::span<T const> ground, std::span<T const> logits) {
+        // cross_entropy of softmax(logits), equal to ce(ground, softmax(logits))
+        // log(softmax(z)) = z - logsumexp(z), so
+        // ce = -(sum(g*z) - sum(g)*logsumexp(z))/n. after the max pass each
+        // block feeds all three sums
+        assert(ground.size() == logits.size());
+        T const* x = logits.data();
+        T max = activation::kernel::max<T>(logits.size(), [=](std::size_t i) { return x[i]; });
+
+        constexpr std::size_t block = 256;
+        std::array<T, block> exps, products;
+        summation::accumulator_t<Sum, T> exp_sum, dot, mass;
+        for (std::size_t first = 0; first < logits.size(); first += block) {
+            std::size_t n = std::min(block, logits.size() - first);
+            T const* g = ground.data() + first;
+            T const* z = logits.data() + first;
+            T* e = exps.data();
+            T* gz = products.data();
+            activation::kernel::loop(n, [=](std::size_t i) {
+                e[i] = activation::math::exp(z[i] - max);
+                gz[i] = g[i]*z[i];
+            });
+            auto identity = [](T term) { return term; };
+            exp_sum += loss::apply_and_accumulate<Sum>(identity, std::span<T const>(e, n));
+            dot += loss::apply_and_accumulate<Sum>(identity, std::span<T const>(gz, n));
+            mass += loss::apply_and_accumulate<Sum>(identity, std::span<T const>(g, n));
+        }
+        T lse = max + std::log(exp_sum.value());
+        return -(dot.value() - mass.value()*lse)/logits.size();
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr T sparse_ce_from_logits (std::size_t target, std::span<T const> logits) {
+        // ce_from_logits with a one-hot ground given by its class index
+        assert(target < logits.size());
+        return -(logits[target] - loss::logsumexp<T, Sum>(logits))/logits.size();
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr T ce_from_logits (std::span<T const> ground, std::span<T const> logits, std::size_t classes) {
+        // mean of ce_from_logits over the rows of row-major [batch, classes] matrices
+        assert(classes > 0 && logits.size() % classes == 0);
+        assert(ground.size() == logits.size());
+        summation::accumulator_t<Sum, T> ce;
+        for (std::size_t row = 0; row < logits.size(); row += classes) {
+            ce += loss::ce_from_logits<T, Sum>(ground.subspan(row, classes), logits.subspan(row, classes));
+        }
+        return ce.value()/(logits.size()/classes);
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr T ce_from_logits (std::span<T const> ground, std::span<T const> logits, std::size_t classes, reduction<T> const& r) {
+        // per-row ce_from_logits reduced by r, weights are per row
+        assert(classes > 0 && logits.size() % classes == 0);
+        assert(ground.size() == logits.size());
+        assert(r.classes == 0);
+        return loss::reduce<Sum>(logits.size()/classes, [&](std::size_t row) -> T {
+            return loss::ce_from_logits<T, Sum>(ground.subspan(row*classes, classes), logits.subspan(row*classes, classes));
+        }, r);
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr T sparse_ce_from_logits (std::span<std::size_t const> targets, std::span<T const> logits) {
+        // mean of sparse_ce_from_logits over a row-major [batch, classes]
+        // logits matrix with one target class per row
+        assert(!targets.empty() && logits.size() % targets.size() == 0);
+        std::size_t classes = logits.size()/targets.size();
+        summation::accumulator_t<Sum, T> ce;
+        for (std::size_t row = 0; row < targets.size(); ++row) {
+            ce += loss::sparse_ce_from_logits<T, Sum>(targets[row], logits.subspan(row*classes, classes));
+        }
+        return ce.value()/targets.size();
+    }
+
+    template <std::floating_point T, summation_policy Sum = summation::naive>
+    static constexpr T sparse_ce_from_logits (std::span<std::size_t const> targets, std::span<T const> logits, reduction<T> const& r) {
+        // per-row sparse_ce_from_logits reduced by r. with r.classes set
+        // the weights are per class and picked by every row's target
+        assert(!targets.empty() && logits.size() % targets.size() == 0);
+        std::size_t classes = logits.size()/targets.size();
+        auto row_ce = [&](std::size_t row) -> T {
+            return loss::sparse_ce_from_logits<T, Sum>(targets[row], logits.subspan(row*classes, classes));
+        };
+        if (r.classes == 0 || r.weights.empty()) {
+            return loss::reduce<Sum>(targets.size(), row_ce, r);
+        }
+
+        assert(r.classes == classes && r.weights.size() >= classes);
+        summation::accumulator_t<Sum, T> total, mass;
+        for (std::size_t row = 0; row < targets.size(); ++row) {
+            T w = r.weights[targets[row]];
+            if (r.mode == reduction_mode::none) {
+                r.out[row] = w*row_ce(row);
+            } else {
+                total += w*row_ce(row);
+                mass += w;
+            }
+        }
+
+        switch (r.mode) {
+            case reduction_mode::none: return T{0};
+            case reduction_mode::sum:  return total.value();
+            case reduction_mode::mean: return total.value()/mass.value();
+        }
+        return T{0};
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T kl (Range const& ground, Range const& predicted, execution policy = execution::sequential) {
+        // KL divergence
+        auto f = [](T gnd, T pred) -> T {
+            using std::log;
+            return gnd*log(gnd/pred);
+        };
+
+        return loss::apply_and_accumulate<Sum>(policy, f, ground, predicted);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T kl (Range const& ground, Range const& predicted, reduction<T> const& r) {
+        // the sum reduction equals kl(ground, predicted)
+        assert(std::ranges::size(ground) == std::ranges::size(predicted));
+        auto gnd = std::ranges::begin(ground);
+        auto pred = std::ranges::begin(predicted);
+        return loss::reduce<Sum>(std::ranges::size(predicted), [&](std::size_t i) -> T {
+            return gnd[i]*std::log(gnd[i]/pred[i]);
+        }, r);
+    }
+
+    template <typename Range, typename T = typename Range::value_type>
+    static constexpr void kl_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // d/dpred kl = -gnd/pred
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            g = -gnd/pred;
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T kl_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        summation::accumulator_t<Sum, T> kl;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            kl += gnd*std::log(gnd/pred);
+            g = -gnd/pred;
+        }
+        return kl.value();
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T contrastive (bool ground, Range const& featuresA, Range const& featuresB, T const margin) {
+        T dist = loss::L2_f<Sum>(featuresA, featuresB);
+        using std::max, std::pow;
+
+        return [&]() -> T {
+            if (ground) {
+                return pow(dist, 2);
+            } else{
+                return pow(max(margin - dist, T{0}), 2);
+            }
+        }();
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T contrastive_value_and_grad (bool ground, Range const& featuresA, Range const& featuresB, T const margin, std::span<typename Range::value_type> grad) {
+        // gradient w.r.t. featuresB, the one w.r.t. featuresA is its negation.
+        // grad first holds d/dB of the distance, (B - A)/dist
+        T dist = loss::L2_value_and_grad<Sum>(featuresA, featuresB, grad);
+        using std::max, std::pow;
+
+        // d/ddist of dist^2 or max(margin - dist, 0)^2
+        T scale = ground ? 2*dist : -2*max(margin - dist, T{0});
+        for (T& g : grad.first(std::ranges::size(featuresB))) {
+            g *= scale;
+        }
+
+        return ground ? pow(dist, 2) : pow(max(margin - dist, T{0}), 2);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr void contrastive_grad (bool ground, Range const& featuresA, Range const& featuresB, T const margin, std::span<typename Range::value_type> grad) {
+        loss::contrastive_value_and_grad<Sum>(ground, featuresA, featuresB, margin, grad);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T hinge (Range const& ground, Range const& predicted, execution policy = execution::sequential) {
+        auto f = [](T gnd, T pred) -> T {
+            using std::max;
+            return max(T{0}, T{1} - gnd*pred);
+        };
+
+        return loss::apply_and_accumulate<Sum>(policy, f, ground, predicted);
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T hinge (Range const& ground, Range const& predicted, reduction<T> const& r) {
+        // the sum reduction equals hinge(ground, predicted)
+        assert(std::ranges::size(ground) == std::ranges::size(predicted));
+        auto gnd = std::ranges::begin(ground);
+        auto pred = std::ranges::begin(predicted);
+        return loss::reduce<Sum>(std::ranges::size(predicted), [&](std::size_t i) -> T {
+            return std::max(T{0}, T{1} - gnd[i]*pred[i]);
+        }, r);
+    }
+
+    template <typename Range, typename T = typename Range::value_type>
+    static constexpr void hinge_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        // -gnd where the margin is violated, 0 elsewhere
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            g = T{1} - gnd*pred > T{0} ? -gnd : T{0};
+        }
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T hinge_value_and_grad (Range const& ground, Range const& predicted, std::span<typename Range::value_type> grad) {
+        assert(std::ranges::size(grad) >= std::ranges::size(predicted));
+        summation::accumulator_t<Sum, T> hinge;
+        for (auto&& [gnd, pred, g] : std::ranges::views::zip(ground, predicted, grad)){
+            T violation = T{1} - gnd*pred;
+            hinge += std::max(T{0}, violation);
+            g = violation > T{0} ? -gnd : T{0};
+        }
+        return hinge.value();
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T tr (Range const& anchor, Range const& positive, Range const& negative, T const margin) {
+        // Triplet Ranking
+        T dist_pos = loss::L2_f<Sum>(anchor, positive);
+        T dist_neg = loss::L2_f<Sum>(anchor, negative);
+        
+        return std::max(dist_pos - dist_neg + margin, T{0});
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr T tr_value_and_grad (Range const& anchor, Range const& positive, Range const& negative, T const margin,
+                                          std::span<typename Range::value_type> grad_anchor,
+                                          std::span<typename Range::value_type> grad_positive,
+                                          std::span<typename Range::value_type> grad_negative) {
+        // Triplet Ranking, gradients w.r.t. all three embeddings.
+        // d/dpositive = (positive - anchor)/dist_pos, d/dnegative = -(negative - anchor)/dist_neg
+        // and the anchor gets the negated sum, all zero when the margin holds
+        T dist_pos = loss::L2_value_and_grad<Sum>(anchor, positive, grad_positive);
+        T dist_neg = loss::L2_value_and_grad<Sum>(anchor, negative, grad_negative);
+        T tr = std::max(dist_pos - dist_neg + margin, T{0});
+
+        T active = tr > T{0} ? T{1} : T{0};
+        assert(std::ranges::size(grad_anchor) >= std::ranges::size(anchor));
+        for (auto&& [ga, gp, gn] : std::ranges::views::zip(grad_anchor, grad_positive, grad_negative)){
+            gp *= active;
+            gn *= -active;
+            ga = -(gp + gn);
+        }
+        return tr;
+    }
+
+    template <summation_policy Sum = summation::naive, typename Range, typename T = summation::accumulation_t<Sum, typename Range::value_type>>
+    static constexpr void tr_grad (Range const& anchor, Range const& positive, Range const& negative, T const margin,
+                                   std::span<typename Range::value_type> grad_anchor,
+                                   std::span<typename Range::value_type> grad_positive,
+                                   std::span<typename Range::value_type> grad_negative) {
+        loss::tr_value_and_grad<Sum>(anchor, positive, negative, margin, grad_anchor, grad_positive, grad_negative);
+    }
+
+    template <typename T>
+    struct matrix_view {
+        // row-major [rows, cols] matrix with a row stride, the inner
+        // dimension is contiguous so every row is a span
+        T* data = nullptr;
+        std::size_t rows = 0;
+        std::size_t cols = 0;
+        std::size_t stride = 0;
+
+        constexpr matrix_view () = default;
+
+        constexpr matrix_view (T* data, std::size_t rows, std::size_t cols, std::size_t stride)
+            : data(data), rows(rows), cols(cols), stride(stride) {
+            assert(stride >= cols);
+        }
+
+        constexpr matrix_view (T* data, std::size_t rows, std::size_t cols)
+            : matrix_view(data, rows, cols, cols) {}
+
+        constexpr matrix_view (std::span<T> values, std::size_t cols)
+            : matrix_view(values.data(), cols ? values.size()/cols : 0, cols) {
+            assert(cols > 0 && values.size() % cols == 0);
+        }
+
+        template <typename U>
+        requires std::is_convertible_v<U(*)[], T(*)[]>
+        constexpr matrix_view (matrix_view<U> other)
+            : matrix_view(other.data, other.rows, other.cols, other.stride) {}
+
+#ifdef __cpp_lib_mdspan
+        template <typename Extents, typename Layout, typename Accessor>
+        requires (Extents::rank() == 2)
+        constexpr matrix_view (std::mdspan<T, Extents, Layout, Accessor> m)
+            : matrix_view(m.data_handle(), m.extent(0), m.extent(1), m.stride(0)) {
+            assert(m.stride(1) == 1);
+        }
+#endif
+
+        constexpr std::span<T> row (std::size_t r) const {
+            assert(r < rows);
+            return {data + r*stride, cols};
+        }
+    };
+
+    namespace batched {
+        // losses over the rows of [batch, dim] matrices in one call. f is
+        // any per-sample loss taking the two rows as spans, e.g.
+        // [](auto g, auto p){ return loss::L1(g, p); }. in parallel mode
+        // contiguous blocks of rows go to the thread pool
+
+        namespace {
+            static constexpr std::size_t row_blocks (execution policy, std::size_t rows, std::size_t cols) {
+                // how many blocks of rows a matrix is split into, a single
+                // block when sequential, when empty or too small to split.
+                // the pool is only touched in parallel mode
+                constexpr std::size_t grain = std::size_t{1} << 14;
+                if (std::is_constant_evaluated() || policy != execution::parallel || rows == 0) {
+                    return 1;
+                }
+                auto& pool = parallel::default_pool();
+                return std::clamp<std::size_t>(rows*cols/grain, 1, std::min(rows, 4*pool.size()));
+            }
+
+            template <typename F>
+            static constexpr void for_row_blocks (std::size_t blocks, std::size_t rows, F f) {
+                // f(block, first, last) over the blocks of row_blocks
+                if (blocks == 1) {
+                    f(std::size_t{0}, std::size_t{0}, rows);
+                    return;
+                }
+                parallel::default_pool().run(blocks, [&](std::size_t block) {
+                    f(block, rows*block/blocks, rows*(block + 1)/blocks);
+                });
+            }
+        }
+
+        template <typename T, typename F>
+        requires std::invocable<F, std::span<T const>, std::span<T const>>
+        static constexpr void per_sample (F f, matrix_view<T const> ground, matrix_view<T const> predicted,
+                                          std::span<std::type_identity_t<T>> out, execution policy = execution::sequential) {
+            // out[r] = f(ground.row(r), predicted.row(r))
+            assert(ground.rows == predicted.rows && ground.cols == predicted.cols);
+            assert(out.size() >= ground.rows);
+            std::size_t blocks = batched::row_blocks(policy, ground.rows, ground.cols);
+            batched::for_row_blocks(blocks, ground.rows, [&](std::size_t, std::size_t first, std::size_t last) {
+                for (std::size_t r = first; r < last; ++r) {
+                    out[r] = f(ground.row(r), predicted.row(r));
+                }
+            });
+        }
+
+        template <summation_policy Sum = summation::naive, typename T, typename F>
+        requires std::invocable<F, std::span<T const>, std::span<T const>>
+        static constexpr T sum (F f, matrix_view<T const> ground, matrix_view<T const> predicted, execution policy = execution::sequential) {
+            // sum of the per-sample losses without materializing them, every
+            // block accumulates its rows and the blocks are added in order
+            assert(ground.rows == predicted.rows && ground.cols == predicted.cols);
+            std::size_t blocks = batched::row_blocks(policy, ground.rows, ground.cols);
+            std::vector<summation::accumulator_t<Sum, T>> partial(blocks);
+            batched::for_row_blocks(blocks, ground.rows, [&](std::size_t block, std::size_t first, std::size_t last) {
+                for (std::size_t r = first; r < last; ++r) {
+                    partial[block] += f(ground.row(r), predicted.row(r));
+                }
+            });
+
+            summation::accumulator_t<Sum, T> total;
+            for (auto const& p : partial) {
+                total += p.value();
+            }
+            return total.value();
+        }
+
+        template <summation_policy Sum = summation::naive, typename T, typename F>
+        requires std::invocable<F, std::span<T const>, std::span<T const>>
+        static constexpr T mean (F f, matrix_view<T const> ground, matrix_view<T const> predicted, execution policy = execution::sequential) {
+            assert(ground.rows > 0);
+            return batched::sum<Sum>(f, ground, predicted, policy)/ground.rows;
+        }
+    }
+}
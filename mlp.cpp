@@ -0,0 +1,60 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <cstdint>
+#include <cstdio>
+
+#include "mlp.hpp"
+
+int main () {
+    // a 4 -> 6 -> 6 -> 2 network written in the mlp file format
+    std::vector<std::uint32_t> sizes = {4, 6, 6, 2};
+    std::vector<mlp::activation_kind> kinds = {mlp::activation_kind::elu, mlp::activation_kind::mish, mlp::activation_kind::sigmoid};
+    std::vector<float> parameters = {0.1f, 0.0f, 0.0f};
+
+    char const* path = "mlp_demo.bin";
+    {
+        std::ofstream file(path, std::ios::binary);
+        std::uint32_t element_size = sizeof(float), layers = kinds.size();
+        file.write("mlp1", 4);
+        file.write(reinterpret_cast<char const*>(&element_size), 4);
+        file.write(reinterpret_cast<char const*>(&layers), 4);
+        file.write(reinterpret_cast<char const*>(sizes.data()), sizes.size()*4);
+        for (std::size_t l = 0; l < kinds.size(); ++l) {
+            file.write(reinterpret_cast<char const*>(&kinds[l]), 4);
+            file.write(reinterpret_cast<char const*>(&parameters[l]), sizeof(float));
+        }
+        for (std::size_t l = 0; l < kinds.size(); ++l) {
+            std::vector<float> w(sizes[l]*sizes[l + 1]), b(sizes[l + 1]);
+            for (std::size_t i = 0; i < w.size(); ++i) w[i] = 0.1f*float(int(i*7 % 11) - 5);
+            for (std::size_t i = 0; i < b.size(); ++i) b[i] = 0.05f*float(i);
+            file.write(reinterpret_cast<char const*>(w.data()), w.size()*sizeof(float));
+            file.write(reinterpret_cast<char const*>(b.data()), b.size()*sizeof(float));
+        }
+    }
+
+    // the buffers are sized for batches of up to 2 rows, larger ones run in chunks
+    auto net = mlp::network<float>::load(path, 2);
+    if (!net) {
+        std::cout << "load failed, error " << int(net.error()) << std::endl;
+        return 1;
+    }
+    std::cout << "loaded " << net->inputs() << " -> " << net->outputs() << std::endl;
+
+    std::vector<float> x = {
+        1.0f, -2.0f, 0.5f, 0.0f,
+        0.3f, 0.1f, -0.4f, 2.0f,
+        -1.0f, 1.0f, 1.0f, -1.0f,
+    };
+    std::vector<float> y(3*net->outputs());
+    net->run(x, y);
+    std::cout << "y = { ";
+    for (float v : y) std::cout << v << " ";
+    std::cout << "}" << std::endl;
+
+    auto wrong = mlp::network<double>::load(path, 2);
+    std::cout << "loading floats as double: " << (wrong ? "ok" : "element_type error") << std::endl;
+
+    std::remove(path);
+    return 0;
+}
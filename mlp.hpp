@@ -0,0 +1,203 @@
+#pragma once
+
+#include <concepts>
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <fstream>
+#include <expected>
+#include <algorithm>
+#include <filesystem>
+
+#include "activation.hpp"
+#include "layer.hpp"
+
+namespace mlp {
+    // inference for multilayer perceptrons of dense layers. all memory is
+    // allocated by load, a request runs the layers between two preallocated
+    // buffers and allocates nothing.
+    //
+    // file format, native byte order:
+    //   char     magic[4]         "mlp1"
+    //   uint32   element size     4 for float, 8 for double
+    //   uint32   layers           L
+    //   uint32   sizes[L + 1]     inputs, then the outputs of every layer
+    //   L times  uint32 activation, T parameter
+    //   L times  T weights[inputs*outputs], row-major, then T bias[outputs]
+
+    enum class activation_kind : std::uint32_t {
+        none, relu, prelu, sigmoid, tanh, elu, swish, softplus, mish, gelu, gelu_tanh, hard_swish, selu
+    };
+
+    enum class load_error { open, format, element_type, truncated };
+
+    template <std::floating_point T>
+    struct dense {
+        layer::weights<T> weights;
+        std::vector<T> bias;
+        activation_kind activation = activation_kind::none;
+        T parameter = 0;    // alpha of prelu and elu, beta of softplus
+    };
+
+    template <std::floating_point T, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    class network {
+    public:
+        network (std::vector<dense<T>> layers, std::size_t max_batch)
+            : layers(std::move(layers)), max_batch(std::max<std::size_t>(max_batch, 1)) {
+            assert(!this->layers.empty());
+            std::size_t width = 0, work = 0;
+            for (std::size_t l = 0; l < this->layers.size(); ++l) {
+                auto const& w = this->layers[l].weights;
+                assert(l == 0 || w.inputs == this->layers[l - 1].weights.outputs);
+                if (l + 1 < this->layers.size()) {
+                    width = std::max(width, w.outputs);
+                }
+                work += w.inputs*w.outputs;
+            }
+            // the hidden activations ping-pong between two buffers, the
+            // first layer reads the request and the last writes the result
+            ping.resize(this->max_batch*width);
+            pong.resize(this->max_batch*width);
+            // below about a million multiply-adds per request a thread pool
+            // wakeup costs more than it saves, those batches run inline
+            parallel_batch = ((std::size_t{1} << 20) + work - 1)/std::max<std::size_t>(work, 1);
+        }
+
+        static std::expected<network, load_error> load (std::filesystem::path const& path, std::size_t max_batch) {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                return std::unexpected(load_error::open);
+            }
+            auto read = [&file](void* data, std::size_t bytes) -> bool {
+                return bool(file.read(static_cast<char*>(data), bytes));
+            };
+
+            char magic[4];
+            std::uint32_t element_size = 0, count = 0;
+            if (!read(magic, 4) || !read(&element_size, 4) || !read(&count, 4)) {
+                return std::unexpected(load_error::truncated);
+            }
+            if (!std::equal(magic, magic + 4, "mlp1") || count == 0) {
+                return std::unexpected(load_error::format);
+            }
+            if (element_size != sizeof(T)) {
+                return std::unexpected(load_error::element_type);
+            }
+
+            // the header sizes are checked against the bytes left in the
+            // file before anything is allocated from them
+            auto here = file.tellg();
+            file.seekg(0, std::ios::end);
+            std::uint64_t left = std::uint64_t(file.tellg() - here);
+            file.seekg(here);
+            std::size_t n = count;
+            if (n > left/(8 + sizeof(T))) {
+                return std::unexpected(load_error::truncated);
+            }
+
+            std::vector<std::uint32_t> sizes(n + 1);
+            if (!read(sizes.data(), sizes.size()*4)) {
+                return std::unexpected(load_error::truncated);
+            }
+            if (std::ranges::find(sizes, 0u) != sizes.end()) {
+                return std::unexpected(load_error::format);
+            }
+            std::uint64_t parameters = 0, room = (left - (n + 1)*4 - n*(4 + sizeof(T)))/sizeof(T);
+            for (std::size_t i = 0; i < n; ++i) {
+                // weights and bias of a layer, below 2^64. compared with
+                // what is left of room so the running sum can't wrap
+                std::uint64_t layer = std::uint64_t{sizes[i]}*sizes[i + 1] + sizes[i + 1];
+                if (layer > room - parameters) {
+                    return std::unexpected(load_error::truncated);
+                }
+                parameters += layer;
+            }
+
+            std::vector<dense<T>> layers(n);
+            for (auto& l : layers) {
+                std::uint32_t kind = 0;
+                if (!read(&kind, 4) || !read(&l.parameter, sizeof(T))) {
+                    return std::unexpected(load_error::truncated);
+                }
+                if (kind > std::uint32_t(activation_kind::selu)) {
+                    return std::unexpected(load_error::format);
+                }
+                l.activation = activation_kind(kind);
+            }
+
+            std::vector<T> w;
+            for (std::size_t i = 0; i < n; ++i) {
+                w.resize(std::size_t{sizes[i]}*sizes[i + 1]);
+                layers[i].bias.resize(sizes[i + 1]);
+                if (!read(w.data(), w.size()*sizeof(T)) || !read(layers[i].bias.data(), sizes[i + 1]*sizeof(T))) {
+                    return std::unexpected(load_error::truncated);
+                }
+                layers[i].weights = layer::weights<T>(w, sizes[i + 1]);
+            }
+            return network(std::move(layers), max_batch);
+        }
+
+        std::size_t inputs () const {
+            return layers.front().weights.inputs;
+        }
+
+        std::size_t outputs () const {
+            return layers.back().weights.outputs;
+        }
+
+        void threading (std::size_t min_batch) {
+            // batches of at least min_batch rows use the thread pool
+            parallel_batch = min_batch;
+        }
+
+        void run (std::span<T const> in, std::span<T> out) {
+            // in is [batch, inputs] and out [batch, outputs], batches larger
+            // than max_batch are run max_batch rows at a time
+            assert(in.size() % inputs() == 0 && out.size() >= in.size()/inputs()*outputs());
+            std::size_t batch = in.size()/inputs();
+            for (std::size_t first = 0; first < batch; first += max_batch) {
+                std::size_t rows = std::min(max_batch, batch - first);
+                forward(in.subspan(first*inputs(), rows*inputs()), out.subspan(first*outputs(), rows*outputs()), rows);
+            }
+        }
+
+    private:
+        std::vector<dense<T>> layers;
+        std::size_t max_batch;
+        std::size_t parallel_batch;
+        std::vector<T> ping, pong;
+
+        void forward (std::span<T const> in, std::span<T> out, std::size_t rows) {
+            auto policy = rows >= parallel_batch ? loss::execution::parallel : loss::execution::sequential;
+            std::span<T const> x = in;
+            for (std::size_t l = 0; l < layers.size(); ++l) {
+                std::span<T> y = l + 1 == layers.size() ? out
+                               : std::span<T>(l % 2 ? pong : ping).first(rows*layers[l].weights.outputs);
+                apply(layers[l], x, y, policy);
+                x = y;
+            }
+        }
+
+        static void apply (dense<T> const& l, std::span<T const> x, std::span<T> y, loss::execution policy) {
+            namespace epilogue = layer::epilogue;
+            switch (l.activation) {
+                case activation_kind::none: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::none{}, policy);
+                case activation_kind::relu: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::relu{}, policy);
+                case activation_kind::prelu: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::prelu{l.parameter}, policy);
+                case activation_kind::sigmoid: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::sigmoid<Accuracy>{}, policy);
+                case activation_kind::tanh: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::tanh<Accuracy>{}, policy);
+                case activation_kind::elu: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::elu<Accuracy>{l.parameter}, policy);
+                case activation_kind::swish: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::swish<Accuracy>{}, policy);
+                case activation_kind::softplus: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::softplus<Accuracy>{l.parameter}, policy);
+                case activation_kind::mish: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::mish<Accuracy>{}, policy);
+                case activation_kind::gelu: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::gelu<Accuracy>{}, policy);
+                case activation_kind::gelu_tanh: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::gelu_tanh<Accuracy>{}, policy);
+                case activation_kind::hard_swish: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::hard_swish{}, policy);
+                case activation_kind::selu: return layer::dense<T>(x, l.weights, l.bias, y, epilogue::selu<Accuracy>{}, policy);
+            }
+        }
+    };
+}
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <vector>
+#include <cstdint>
+
+#include "quantized.hpp"
+
+int main () {
+    // int8 inputs with scale 1/16 cover [-8, 8), sigmoid results [0, 1)
+    // are stored with scale 1/256 and zero point -128
+    quantized::quantization in{1.0f/16, 0}, unit{1.0f/256, -128};
+    auto sigmoid = quantized::sigmoid<std::int8_t>(in, unit);
+
+    std::vector<std::int8_t> x = {-128, -32, -16, 0, 16, 32, 127};
+    std::vector<std::int8_t> y(x.size());
+    quantized::lookup<std::int8_t>(sigmoid, x, y);
+    std::cout << "sigmoid, int8:" << std::endl;
+    for (std::size_t i = 0; i < x.size(); ++i) {
+        float real = unit.scale*float(y[i] - unit.zero_point);
+        std::cout << "  " << int(x[i]) << " -> " << int(y[i]) << " (" << real << ")" << std::endl;
+    }
+
+    // uint8 with the zero point in the middle, tanh in place
+    quantized::quantization centered{1.0f/32, 128}, symmetric{1.0f/128, 128};
+    auto tanh = quantized::tanh<std::uint8_t>(centered, symmetric);
+    std::vector<std::uint8_t> z = {0, 96, 128, 160, 255};
+    quantized::lookup<std::uint8_t>(tanh, z);
+    std::cout << "tanh, uint8 in-place = { ";
+    for (auto v : z) std::cout << int(v) << " ";
+    std::cout << "}" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <concepts>
+
+#include <bit>
+#include <span>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "activation.hpp"
+
+namespace quantized {
+    // activations of int8 and uint8 tensors for quantized inference, where
+    // q stands for the real value scale*(q - zero_point) as in tflite and
+    // onnx. an 8-bit input takes only 256 values, so an activation is a table
+    // of its 256 results, computed once from the float implementation, and
+    // applying it is a byte lookup. the lookup is done with shuffles: 64
+    // bytes in three instructions with avx512 vbmi, 32 bytes in sixteen
+    // rounds of pshufb with avx2.
+
+    template <typename Q>
+    concept byte = std::same_as<Q, std::int8_t> || std::same_as<Q, std::uint8_t>;
+
+    struct quantization {
+        float scale;
+        std::int32_t zero_point;
+    };
+
+    template <byte Q>
+    struct table {
+        // entries[b] is the bit pattern of the result for the input whose
+        // bit pattern is b, so int8 and uint8 share the lookup
+        alignas(64) std::array<std::uint8_t, 256> entries;
+
+        template <typename F>
+        table (quantization in, quantization out, F f) {
+            // f over the dequantized input, the result rounded to nearest
+            // and saturated to Q. a nan result maps to the real value 0
+            assert(in.scale > 0 && out.scale > 0);
+            constexpr float lo = std::numeric_limits<Q>::min(), hi = std::numeric_limits<Q>::max();
+            for (std::size_t b = 0; b < entries.size(); ++b) {
+                float x = in.scale*float(int(std::bit_cast<Q>(std::uint8_t(b))) - in.zero_point);
+                float q = std::nearbyint(f(x)/out.scale) + float(out.zero_point);
+                if (std::isnan(q)) {
+                    q = float(out.zero_point);
+                }
+                entries[b] = std::bit_cast<std::uint8_t>(Q(std::clamp(q, lo, hi)));
+            }
+        }
+
+        constexpr Q operator() (Q q) const {
+            return std::bit_cast<Q>(entries[std::bit_cast<std::uint8_t>(q)]);
+        }
+    };
+
+    namespace kernel {
+        // y[i] = t[x[i]] over bytes, dispatched at runtime as
+        // activation::kernel::loop. these are written with intrinsics, a
+        // table lookup does not auto-vectorize into shuffles
+
+        static void lookup_generic (std::uint8_t const* t, std::uint8_t const* x, std::uint8_t* y, std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) y[i] = t[x[i]];
+        }
+
+    #if defined(__x86_64__) || defined(__i386__)
+        static bool vbmi () {
+            static bool const s = [] {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw");
+            }();
+            return s;
+        }
+
+        [[gnu::target("avx2")]]
+        static void lookup_avx2 (std::uint8_t const* t, std::uint8_t const* x, std::uint8_t* y, std::size_t n) {
+            // pshufb looks up 16 entries by the low nibble. row k answers for
+            // the bytes with v = x - 16k in [0, 16): adding 0x70 with
+            // saturation leaves the top bit clear there and sets it for every
+            // other byte, which pshufb turns into 0, so or-ing the 16 rows
+            // leaves each byte's entry
+            __m256i rows[16];
+            for (int k = 0; k < 16; ++k) {
+                rows[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(t + 16*k)));
+            }
+            __m256i const bias = _mm256_set1_epi8(0x70), step = _mm256_set1_epi8(16);
+            std::size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(x + i));
+                __m256i r = _mm256_setzero_si256();
+                for (int k = 0; k < 16; ++k) {
+                    r = _mm256_or_si256(r, _mm256_shuffle_epi8(rows[k], _mm256_adds_epu8(v, bias)));
+                    v = _mm256_sub_epi8(v, step);
+                }
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i), r);
+            }
+            lookup_generic(t, x + i, y + i, n - i);
+        }
+
+        [[gnu::target("avx512f,avx512bw,avx512vbmi")]]
+        static void lookup_vbmi (std::uint8_t const* t, std::uint8_t const* x, std::uint8_t* y, std::size_t n) {
+            // vpermi2b looks up 128 entries from two registers by the low
+            // seven bits, the top bit picks the lower or upper half
+            __m512i t0 = _mm512_load_si512(t), t1 = _mm512_load_si512(t + 64);
+            __m512i t2 = _mm512_load_si512(t + 128), t3 = _mm512_load_si512(t + 192);
+            for (std::size_t i = 0; i < n; i += 64) {
+                // the tail is a masked load and store
+                __mmask64 mask = n - i >= 64 ? ~__mmask64{0} : (__mmask64{1} << (n - i)) - 1;
+                __m512i v = _mm512_maskz_loadu_epi8(mask, x + i);
+                __m512i lo = _mm512_permutex2var_epi8(t0, v, t1);
+                __m512i hi = _mm512_permutex2var_epi8(t2, v, t3);
+                _mm512_mask_storeu_epi8(y + i, mask, _mm512_mask_blend_epi8(_mm512_movepi8_mask(v), lo, hi));
+            }
+        }
+    #endif
+
+        static void lookup (std::uint8_t const* t, std::uint8_t const* x, std::uint8_t* y, std::size_t n) {
+        #if defined(__x86_64__) || defined(__i386__)
+            if (vbmi()) {
+                return lookup_vbmi(t, x, y, n);
+            }
+            if (activation::kernel::selected() != activation::kernel::isa::generic) {
+                return lookup_avx2(t, x, y, n);
+            }
+        #endif
+            lookup_generic(t, x, y, n);
+        }
+    }
+
+    template <byte Q>
+    static void lookup (table<Q> const& t, std::span<Q const> in, std::span<Q> out) {
+        // out[i] = t(in[i]), in and out may be the same buffer
+        // the byte pointers are not dependent, so the call binds here and
+        // kernel::lookup counts as used in units that never call this
+        assert(out.size() >= in.size());
+        std::uint8_t const* entries = t.entries.data();
+        std::uint8_t const* x = reinterpret_cast<std::uint8_t const*>(in.data());
+        std::uint8_t* y = reinterpret_cast<std::uint8_t*>(out.data());
+        std::size_t n = in.size();
+        kernel::lookup(entries, x, y, n);
+    }
+
+    template <byte Q>
+    static void lookup (table<Q> const& t, std::span<Q> z) {
+        quantized::lookup<Q>(t, z, z);
+    }
+
+    // tables of the float activations. the output quantization of sigmoid
+    // is usually {1/256, -128} for int8 and {1/256, 0} for uint8, of tanh
+    // {1/128, 0} for int8 and {1/128, 128} for uint8
+
+    template <byte Q, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    static table<Q> sigmoid (quantization in, quantization out) {
+        return table<Q>(in, out, [](float x) { return activation::sigmoid<float, Accuracy>(x); });
+    }
+
+    template <byte Q, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    static table<Q> tanh (quantization in, quantization out) {
+        return table<Q>(in, out, [](float x) { return activation::tanh<float, Accuracy>(x); });
+    }
+
+    template <byte Q, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    static table<Q> elu (quantization in, quantization out, float alpha) {
+        return table<Q>(in, out, [alpha](float x) { return activation::elu<float, Accuracy>(x, alpha); });
+    }
+
+    template <byte Q, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    static table<Q> swish (quantization in, quantization out) {
+        return table<Q>(in, out, [](float x) { return activation::swish<float, Accuracy>(x); });
+    }
+
+    template <byte Q, activation::accuracy::policy Accuracy = activation::accuracy::ulp1>
+    static table<Q> gelu (quantization in, quantization out) {
+        return table<Q>(in, out, [](float x) { return activation::gelu<float, Accuracy>(x); });
+    }
+
+    template <byte Q>
+    static table<Q> hard_swish (quantization in, quantization out) {
+        return table<Q>(in, out, [](float x) { return activation::hard_swish(x); });
+    }
+}